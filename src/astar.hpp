@@ -1,6 +1,9 @@
 // Copyright 2012 Ethan Burns. All rights reserved.
 // Use of this source code is governed by an MIT-style
 // license that can be found in the LICENSE file.
+#ifndef _ASTAR_HPP_
+#define _ASTAR_HPP_
+
 #include <stdio.h>
 
 #include "search.hpp"
@@ -9,6 +12,7 @@
 #include "heap.hpp"
 #include "naive_heap.hpp"
 #include "pool.hpp"
+#include "shared_incumbent.hpp"
 
 template<class D> class Astar: public SearchAlg<D> {
 
@@ -86,6 +90,8 @@ public:
 
 		while (!open.isempty() && path.size() == 0) {
 //			printf("while loop\n");
+			if (this->shared && this->shared->stop)
+				break;
 			Node *n = static_cast<Node*>(open.pop());
 			if (closed.find(n->packed)) {
 //				std::cout << "destruct" << std::endl;
@@ -102,6 +108,12 @@ public:
 			}
 			typename D::State state;
 			this->dom.unpack(state, n->packed);
+			if (this->shared
+					&& n->g + this->dom.h(state)
+							>= (unsigned int) this->shared->cost) {
+				nodes.destruct(n);
+				continue;
+			}
 
 //			printf("expd = %lu\n", this->expd);
 //			Grid::State s = static_cast<Grid::State>(state);
@@ -116,6 +128,8 @@ public:
 					this->dom.unpack(s, p->packed);
 					path.push_back(s);
 				}
+				if (this->shared)
+					this->shared->offer(n->g, path);
 				break;
 			}
 
@@ -155,7 +169,8 @@ public:
 				/// Compare states
 				/// 1. operation working fine
 				///////////////////////////
-				if (n->f > next->f) {
+				// f may decrease with a weighted heuristic.
+				if (w == 1 && n->f > next->f) {
 					// heuristic was calculating too big.
 					printf("!!!ERROR: f decreases: %u %u\n", n->f, next->f);
 					unsigned int nh = n->f - n->g;
@@ -178,6 +193,8 @@ public:
 //					}
 //					printf("\n");
 //					printf("\n");
+					nodes.destruct(next);
+					this->dom.undo(state, e);
 					continue;
 				}
 				if (static_cast<unsigned int>(n->g + e.cost)
@@ -189,6 +206,7 @@ public:
 				if (next->f > incumbent) {
 //					delete next;
 					printf("f > incumbent\n");
+					nodes.destruct(next);
 					this->dom.undo(state, e);
 					continue;
 				}
@@ -228,3 +246,5 @@ public:
 	}
 
 };
+
+#endif // _ASTAR_HPP_
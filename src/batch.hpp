@@ -0,0 +1,144 @@
+/*
+ * batch.hpp
+ *
+ * Batch solves a range of instances (one per line, as read by
+ * D(FILE*, line)) with HDA* in one process. The threads, the closed
+ * lists and node pools (HDAstar::Arena) and the static domain tables
+ * such as the Tiles24 pattern databases are set up once and reused by
+ * every instance. The file is read once; each instance is parsed from
+ * its own line.
+ *
+ * SHARED solves the instances one after another with all threads.
+ * SPLIT solves tnum instances at a time with one thread each.
+ *
+ * Each instance prints one "instance" row: line, threads, solution
+ * cost (-1 if none), nodes expanded, nodes generated, duplicates and
+ * wall time.
+ */
+
+#ifndef BATCH_HPP_
+#define BATCH_HPP_
+
+#include "hdastar.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+#include "fatal.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <functional>
+#include <pthread.h>
+
+template<class D> class Batch {
+public:
+	enum Mode {
+		SHARED, SPLIT,
+	};
+
+	// setup is called on each domain before it is searched, e.g. to
+	// select the heuristic and the distribution hash.
+	Batch(int tnum, Mode mode, std::function<void(D&)> setup,
+			unsigned int closedlistsize = 110503,
+			unsigned int openlistsize = 100) :
+			tnum(tnum), mode(mode), setup(setup), closedlistsize(
+					closedlistsize), openlistsize(openlistsize), pool(tnum), last(
+					0), next(0), slot(0) {
+		if (mode == SHARED) {
+			arenas.push_back(
+					new typename HDAstar<D>::Arena(tnum, closedlistsize));
+		} else {
+			for (int i = 0; i < tnum; ++i)
+				arenas.push_back(
+						new typename HDAstar<D>::Arena(1, closedlistsize));
+		}
+	}
+
+	~Batch() {
+		for (unsigned int i = 0; i < arenas.size(); ++i)
+			delete arenas[i];
+	}
+
+	// run solves the instances on lines first to last of file.
+	void run(const char* file, int first, int last) {
+		std::ifstream in(file);
+		if (!in)
+			throw Fatal("Failed to open %s", file);
+		lines.clear();
+		std::string l;
+		while (std::getline(in, l))
+			if (l.find_first_not_of(" \t\r") != std::string::npos)
+				lines.push_back(l);
+		if (first < 1 || last > (int) lines.size())
+			throw Fatal("Batch: %s has %u instances, not lines %d to %d",
+					file, (unsigned int) lines.size(), first, last);
+		this->last = last;
+
+		dfrowhdr(stdout, "instance", 7, "line", "threads", "solution cost",
+				"nodes expanded", "nodes generated", "duplicates",
+				"wall time");
+
+		if (mode == SHARED) {
+			for (int line = first; line <= last; ++line)
+				solve(line, tnum, arenas[0]);
+		} else {
+			next = first;
+			slot = 0;
+			pool.run(tnum, &Batch::split_helper, this);
+		}
+	}
+
+private:
+
+	static void* split_helper(void* arg) {
+		static_cast<Batch*>(arg)->split_worker();
+		return 0;
+	}
+
+	void split_worker() {
+		int id = slot.fetch_add(1);
+		for (int line = next.fetch_add(1); line <= last;
+				line = next.fetch_add(1))
+			solve(line, 1, arenas[id]);
+	}
+
+	void solve(int line, int threads, typename HDAstar<D>::Arena* arena) {
+		std::string &l = lines[line - 1];
+		FILE* in = fmemopen(&l[0], l.size(), "r");
+		if (!in)
+			throw Fatal("Batch: fmemopen failed");
+		D dom(in, 1);
+		fclose(in);
+		setup(dom);
+
+		typename D::State init = dom.initial();
+		HDAstar<D> alg(dom, threads, 1000000, 10000000, 0, 0, closedlistsize,
+				openlistsize);
+		alg.set_arena(arena);
+		alg.set_thread_pool(&pool);
+
+		double wall = walltime();
+		std::vector<typename D::State> path = alg.search(init);
+		wall = walltime() - wall;
+
+		dfrow(stdout, "instance", "dduuuug", (long) line, (long) threads,
+				(long) path.size() - 1, alg.expd, alg.gend, alg.dup, wall);
+	}
+
+	int tnum;
+	Mode mode;
+	std::function<void(D&)> setup;
+	unsigned int closedlistsize, openlistsize;
+
+	ThreadPool pool;
+	std::vector<typename HDAstar<D>::Arena*> arenas;
+
+	std::vector<std::string> lines; // the instances, one per line.
+	int last;
+	std::atomic<int> next; // next line for SPLIT.
+	std::atomic<int> slot; // arena of the next SPLIT worker.
+};
+
+#endif /* BATCH_HPP_ */
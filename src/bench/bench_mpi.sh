@@ -0,0 +1,89 @@
+#!/bin/bash
+
+# Single-host scaling of HDAstarCombMPI against the threaded HDAstar.
+# Run from src/ after make mpi_bench.
+#
+# 1: instance file        (default instances)
+# 2: instance lines       (default "8 10")
+# 3: numbers of ranks     (default "1 2 4")
+# 4: outgo threshold      (default 32)
+# 5: one-sided transport  (default 0)
+#
+# MPIRUN and MPIRUN_FLAGS (e.g. --oversubscribe) set the launcher.
+# The raw output goes to bench_mpi.log.
+#
+# For each instance and n, against HDA* with 1 thread:
+#   speedup     wall(HDA*, 1) / wall
+#   search ovh  expansions / expansions(HDA*, 1) - 1
+#   comm ovh    nodes sent to another rank / nodes generated
+
+file=${1:-instances}
+lines=${2:-"8 10"}
+nps=${3:-"1 2 4"}
+outgo=${4:-32}
+onesided=${5:-0}
+mpirun=${MPIRUN:-mpirun}
+log=bench_mpi.log
+
+: > $log
+
+for line in $lines
+do
+    echo "### instance $file $line" >> $log
+    echo "## hda 1" >> $log
+    ./mpi_bench hda $file $line 1 >> $log
+    for np in $nps
+    do
+	echo "## hda $np" >> $log
+	./mpi_bench hda $file $line $np >> $log
+	echo "## comb $np" >> $log
+	$mpirun $MPIRUN_FLAGS -np $np ./mpi_bench comb $file $line $outgo $onesided >> $log
+    done
+done
+
+awk '
+function report() {
+    if (comb_np == 0)
+	return
+    printf("%-8s %4d %8.3f %7.2f %8.3f %7.2f %9.3f %8.3f %8d %10d %10d %7.3f %6.2f %9.4f\n",
+	   inst, comb_np, hda_wall, base_wall / hda_wall, wall,
+	   base_wall / wall, expd / base_expd - 1,
+	   (gend - lpush) / gend, msgs, bytes, polls, idle / comb_np,
+	   maxexpd * comb_np / expd, latency)
+    for (r = 0; r < comb_np; ++r)
+	printf("%14s rank %3d: expd %10d sent %10d messages %8d bytes %11d polls %10d idle %8.3f\n",
+	       "", r, rexpd[r], rsent[r], rmsgs[r], rbytes[r], rpolls[r], ridle[r])
+    comb_np = 0
+}
+BEGIN {
+    printf("%-8s %4s %8s %7s %8s %7s %9s %8s %8s %10s %10s %7s %6s %9s\n",
+	   "instance", "n", "HDA*", "speedup", "MPI", "speedup",
+	   "searchovh", "commovh", "messages", "bytes", "polls", "idle",
+	   "balance", "latency")
+}
+/^### instance/ { report(); inst = $4 }
+/^## / { mode = $2; n = $3 }
+/^result = hda/ {
+    if (n == 1 && mode == "hda" && !seen[inst]++) {
+	base_wall = $5; base_expd = $6
+    }
+    hda_wall = $5
+}
+/^## comb/ {
+    report()
+    comb_np = 0; expd = gend = lpush = msgs = bytes = polls = idle = 0
+    maxexpd = 0; latency = 0
+}
+/^rank stats = / {
+    r = $4
+    rexpd[r] = $5; rsent[r] = $6 - $7; rmsgs[r] = $8; rbytes[r] = $9
+    rpolls[r] = $10; ridle[r] = $11
+    expd += $5; gend += $6; lpush += $7; msgs += $8; bytes += $9
+    polls += $10; idle += $11; latency = $12
+    if ($5 > maxexpd)
+	maxexpd = $5
+    ++comb_np
+}
+/^result = comb/ { wall = $5 }
+END { report() }
+' $log
@@ -0,0 +1,92 @@
+/*
+ * mpi_bench.cc
+ *
+ * Driver of bench_mpi.sh. Solves one 15-puzzle instance with
+ * HDAstarCombMPI (under mpirun) or with the threaded HDAstar and prints
+ * a result line. For HDAstar it holds the threads, the wall time, the
+ * nodes expanded, generated and pushed locally and the cost; for
+ * HDAstarCombMPI the ranks, the wall time and the cost, as the node
+ * counts are in its "rank stats" lines, one per rank. hybrid runs
+ * HDAstarHybridMPI with threads threads per rank and prints the ranks,
+ * the threads, the wall time and the cost.
+ *
+ * usage: mpi_bench comb <instance file> <line> [outgo threshold] [one-sided]
+ *        mpi_bench hda <instance file> <line> <threads>
+ *        mpi_bench hybrid <instance file> <line> <threads>
+ */
+
+#include "../tiles.hpp"
+#include "../hdastar.hpp"
+#include "../mpi/hdastar_comb_mpi.hpp"
+#include "../mpi/hdastar_hybrid_mpi.hpp"
+#include "../utils.hpp"
+#include "../fatal.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s comb|hda|hybrid <instance file> <line> ...\n",
+				argv[0]);
+		return 1;
+	}
+	bool comb = strcmp(argv[1], "comb") == 0;
+	bool hybrid = strcmp(argv[1], "hybrid") == 0;
+	if (comb)
+		MPI_Init(&argc, &argv);
+	if (hybrid) {
+		int provided;
+		MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+	}
+
+	FILE *f = fopen(argv[2], "r");
+	if (!f)
+		throw Fatal("Failed to open %s", argv[2]);
+	Tiles dom(f, atoi(argv[3]));
+	fclose(f);
+	dom.set_dist_hash(0);
+	dom.set_heuristic(0);
+	Tiles::State init = dom.initial();
+
+	std::vector<Tiles::State> path;
+	double wall;
+	if (comb) {
+		int ranks, rank;
+		MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+		int outgo = argc > 4 ? atoi(argv[4]) : 32;
+		HDAstarCombMPI<Tiles> alg(dom, ranks, outgo);
+		if (argc > 5 && atoi(argv[5]))
+			alg.set_transport(HDAstarCombMPI<Tiles>::ONE_SIDED);
+		wall = walltime();
+		path = alg.search(init); // calls MPI_Finalize
+		wall = walltime() - wall;
+		if (rank == 0)
+			printf("result = comb %d %f %lu\n", ranks, wall, path.size() - 1);
+	} else if (hybrid) {
+		int ranks, rank;
+		MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+		int threads = argc > 4 ? atoi(argv[4]) : 1;
+		HDAstarHybridMPI<Tiles> alg(dom, threads);
+		wall = walltime();
+		alg.search(init);
+		wall = walltime() - wall;
+		if (rank == 0)
+			printf("result = hybrid %d %d %f %d\n", ranks, threads, wall,
+					alg.cost());
+		MPI_Finalize();
+	} else {
+		int threads = argc > 4 ? atoi(argv[4]) : 1;
+		HDAstar<Tiles> alg(dom, threads);
+		wall = walltime();
+		path = alg.search(init);
+		wall = walltime() - wall;
+		printf("result = hda %d %f %lu %lu %lu %lu\n", threads, wall,
+				alg.expd, alg.gend, alg.lpush, path.size() - 1);
+	}
+	return 0;
+}
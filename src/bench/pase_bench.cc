@@ -0,0 +1,138 @@
+/*
+ * pase_bench.cc
+ *
+ * Pase against HDAstar on a 15-puzzle instance or a grid map, for each
+ * number of threads given. Each row holds the wall time, the nodes
+ * expanded and generated, the cost and the search overhead: expansions
+ * over those of Pase on one thread, which expands what A* does.
+ *
+ * check is a stress test: it solves each instance of the lines given
+ * with A* and then runs times times with Pase on threads threads, and
+ * fails if any run returns another cost.
+ *
+ * usage: pase_bench tiles <instance file> <line> <threads>...
+ *        pase_bench grid <map file> <threads>...
+ *        pase_bench check <instance file> <first line> <last line>
+ *                   <threads> <times>
+ */
+
+#include "../tiles.hpp"
+#include "../grid.hpp"
+#include "../hdastar.hpp"
+#include "../pase.hpp"
+#include "../astar.hpp"
+#include "../utils.hpp"
+#include "../fatal.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+template<class D> static void bench(D &dom, std::vector<int> &threads,
+		unsigned int maxf) {
+	typename D::State init = dom.initial();
+	std::vector<double> rows;
+	double base = 0;
+	for (int alg = 0; alg < 2; ++alg)
+		for (unsigned int i = 0; i < threads.size(); ++i) {
+			SearchAlg<D> *search;
+			if (alg == 0)
+				search = new Pase<D>(dom, threads[i], 4000037, maxf);
+			else
+				search = new HDAstar<D>(dom, threads[i], 1000000, 10000000,
+						0, 0, 110503, maxf);
+			typename D::State s = init;
+			double wall = walltime();
+			std::vector<typename D::State> path = search->search(s);
+			wall = walltime() - wall;
+			if (alg == 0 && threads[i] == 1)
+				base = search->expd;
+			rows.push_back(alg);
+			rows.push_back(threads[i]);
+			rows.push_back(wall);
+			rows.push_back(search->expd);
+			rows.push_back(search->gend);
+			rows.push_back((long) path.size() - 1);
+			delete search;
+		}
+
+	dfrowhdr(stdout, "pase bench", 7, "hdastar", "threads", "wall time",
+			"nodes expanded", "nodes generated", "cost", "search overhead");
+	for (unsigned int i = 0; i < rows.size(); i += 6)
+		dfrow(stdout, "pase bench", "ddguudg", (long) rows[i],
+				(long) rows[i + 1], rows[i + 2], (unsigned long) rows[i + 3],
+				(unsigned long) rows[i + 4], (long) rows[i + 5],
+				base > 0 ? rows[i + 3] / base - 1 : 0);
+}
+
+// check returns the number of runs that did not match A*.
+static int check(const char *file, int first, int last, int threads,
+		int times) {
+	int bad = 0;
+	dfrowhdr(stdout, "pase check", 4, "line", "optimal cost", "runs",
+			"mismatches");
+	for (int line = first; line <= last; ++line) {
+		FILE *f = fopen(file, "r");
+		if (!f)
+			throw Fatal("Failed to open %s", file);
+		Tiles dom(f, line);
+		fclose(f);
+		dom.set_dist_hash(0);
+		dom.set_heuristic(0);
+		Tiles::State init = dom.initial();
+		Astar<Tiles> astar(dom);
+		long cost = (long) astar.search(init).size() - 1;
+		int mismatches = 0;
+		for (int i = 0; i < times; ++i) {
+			Pase<Tiles> pase(dom, threads);
+			Tiles::State s = dom.initial();
+			if ((long) pase.search(s).size() - 1 != cost)
+				++mismatches;
+		}
+		dfrow(stdout, "pase check", "ddud", (long) line, cost,
+				(unsigned long) times, (long) mismatches);
+		bad += mismatches;
+	}
+	return bad;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc > 1 && strcmp(argv[1], "check") == 0) {
+		if (argc < 7) {
+			fprintf(stderr, "usage: %s check <instance file> <first line> "
+					"<last line> <threads> <times>\n", argv[0]);
+			return 1;
+		}
+		return check(argv[2], atoi(argv[3]), atoi(argv[4]), atoi(argv[5]),
+				atoi(argv[6])) ? 1 : 0;
+	}
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s tiles <instance file> <line> <threads>...\n"
+				"       %s grid <map file> <threads>...\n", argv[0], argv[0]);
+		return 1;
+	}
+	bool tiles = strcmp(argv[1], "tiles") == 0;
+	std::vector<int> threads;
+	for (int i = tiles ? 4 : 3; i < argc; ++i)
+		threads.push_back(atoi(argv[i]));
+
+	if (tiles) {
+		FILE *f = fopen(argv[2], "r");
+		if (!f)
+			throw Fatal("Failed to open %s", argv[2]);
+		Tiles dom(f, atoi(argv[3]));
+		fclose(f);
+		dom.set_dist_hash(0);
+		dom.set_heuristic(0);
+		bench(dom, threads, 100);
+	} else {
+		std::ifstream in(argv[2]);
+		if (!in)
+			throw Fatal("Failed to open %s", argv[2]);
+		Grid dom(in, 1);
+		bench(dom, threads, 1 << 16);
+	}
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * pq_bench.cc
+ *
+ * Throughput and rank error of the concurrent open lists of PPAstar,
+ * ConcurrentHeap and MultiQueue, on the hold model: the open list starts
+ * with nodes nodes and every thread repeatedly pops a node and pushes a
+ * child of it with the same or a 2 larger f and a 1 larger g, as in the
+ * 15-puzzle.
+ *
+ * Each configuration runs twice. The first run is timed. In the second
+ * every thread logs its operations, ordered by a shared counter taken
+ * right before a push and right after a pop, so that a node is pushed
+ * before it is popped, and the log is replayed on an exact set: the
+ * rank error of a pop is the number of nodes present that come before
+ * the node it returned.
+ *
+ * usage: pq_bench [threads] [nodes] [pops per thread] [buffer size]
+ *
+ * Each row is one open list: ConcurrentHeap with one heap per thread and
+ * MultiQueue with 2, 4 and 8 queues per thread.
+ */
+
+#include "../concurrent_heap.hpp"
+#include "../multiqueue.hpp"
+#include "../utils.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <pthread.h>
+
+static const int Maxf = 4096;
+static const int Maxg = 128;
+
+struct Elm {
+	int f, g;
+	unsigned int zbr;
+	int openind;
+};
+
+struct Op {
+	unsigned long seq;
+	int key; // pushed if positive, popped if negative, plus one
+};
+
+static int key(const Elm *n) {
+	return n->f * Maxg + Maxg - 1 - n->g;
+}
+
+template<class Open> struct Bench {
+	Open *open;
+	int threads;
+	unsigned long pops;
+	bool log;
+	std::atomic<unsigned long> seq;
+	std::atomic<int> thread_id;
+	std::vector<std::vector<Op> > ops;
+	std::vector<unsigned long> misses;
+
+	static void *helper(void *arg) {
+		static_cast<Bench*>(arg)->run();
+		return 0;
+	}
+
+	void record(int id, int k) {
+		Op o;
+		o.seq = seq.fetch_add(1);
+		o.key = k;
+		ops[id].push_back(o);
+	}
+
+	void run() {
+		int id = thread_id.fetch_add(1);
+		unsigned long rng = 0x9E3779B97F4A7C15UL * (id + 1);
+		for (unsigned long i = 0; i < pops; ++i) {
+			Elm *n = open->pop(id);
+			if (!n) {
+				++misses[id];
+				--i;
+				continue;
+			}
+			if (log)
+				record(id, -key(n) - 1);
+			rng ^= rng << 13;
+			rng ^= rng >> 7;
+			rng ^= rng << 17;
+			n->f = std::min(n->f + (int) (rng >> 40 & 1) * 2, Maxf - 1);
+			n->g = std::min(n->g + 1, Maxg - 1);
+			n->zbr = rng >> 8;
+			if (log)
+				record(id, key(n) + 1);
+			open->push(n, id);
+		}
+	}
+};
+
+// fill pushes nodes random nodes from a fixed seed, logged as seq 0.
+template<class Open> static void fill(Open &open, std::vector<Elm> &elms,
+		std::vector<Op> &log) {
+	srand(1);
+	for (unsigned int i = 0; i < elms.size(); ++i) {
+		elms[i].f = rand() % 64;
+		elms[i].g = rand() % 32;
+		elms[i].zbr = rand();
+		elms[i].openind = -1;
+		open.push(&elms[i]);
+		Op o;
+		o.seq = 0;
+		o.key = key(&elms[i]) + 1;
+		log.push_back(o);
+	}
+}
+
+static bool byseq(const Op &a, const Op &b) {
+	return a.seq < b.seq;
+}
+
+// replay returns the mean rank error and sets max to the largest.
+static double replay(std::vector<Op> &log, unsigned long &max) {
+	std::stable_sort(log.begin(), log.end(), byseq);
+	std::vector<long> tree(Maxf * Maxg + 1, 0); // Fenwick
+	double sum = 0;
+	unsigned long n = 0;
+	max = 0;
+	for (unsigned int i = 0; i < log.size(); ++i) {
+		int k = log[i].key > 0 ? log[i].key - 1 : -log[i].key - 1;
+		if (log[i].key < 0) {
+			unsigned long rank = 0;
+			for (int j = k; j > 0; j -= j & -j)
+				rank += tree[j];
+			sum += rank;
+			if (rank > max)
+				max = rank;
+			++n;
+		}
+		for (int j = k + 1; j <= Maxf * Maxg; j += j & -j)
+			tree[j] += log[i].key > 0 ? 1 : -1;
+	}
+	return n ? sum / n : 0;
+}
+
+static ConcurrentHeap<Elm> *make(ConcurrentHeap<Elm>*, int queues,
+		int threads, int) {
+	return new ConcurrentHeap<Elm>(Maxf, queues, threads, false, 0, 0);
+}
+
+static MultiQueue<Elm> *make(MultiQueue<Elm>*, int queues, int threads,
+		int buffer) {
+	return new MultiQueue<Elm>(Maxf, queues, threads, buffer);
+}
+
+template<class Open> static void bench(bool multiqueue, int queues,
+		int threads, int nodes, unsigned long pops, int buffer) {
+	double wall = 0;
+	double mean = 0;
+	unsigned long max = 0, misses = 0;
+	for (int pass = 0; pass < 2; ++pass) {
+		Open *open = make((Open*) 0, queues, threads, buffer);
+		std::vector<Elm> elms(nodes);
+		std::vector<Op> log;
+		fill(*open, elms, log);
+
+		Bench<Open> b;
+		b.open = open;
+		b.threads = threads;
+		b.pops = pops;
+		b.log = pass == 1;
+		b.seq = 1;
+		b.thread_id = 0;
+		b.ops.resize(threads);
+		b.misses.assign(threads, 0);
+		if (b.log)
+			for (int i = 0; i < threads; ++i)
+				b.ops[i].reserve(2 * pops);
+
+		std::vector<pthread_t> t(threads);
+		double w = walltime();
+		for (int i = 0; i < threads; ++i)
+			pthread_create(&t[i], NULL, &Bench<Open>::helper, &b);
+		for (int i = 0; i < threads; ++i)
+			pthread_join(t[i], NULL);
+		w = walltime() - w;
+
+		if (pass == 0) {
+			wall = w;
+			for (int i = 0; i < threads; ++i)
+				misses += b.misses[i];
+		} else {
+			for (int i = 0; i < threads; ++i)
+				log.insert(log.end(), b.ops[i].begin(), b.ops[i].end());
+			mean = replay(log, max);
+		}
+		delete open;
+	}
+	dfrow(stdout, "open list", "dddguugu", (long) multiqueue, (long) queues,
+			(long) threads, threads * pops / wall, misses,
+			(unsigned long) nodes, mean, max);
+}
+
+int main(int argc, char *argv[]) {
+	int threads = argc > 1 ? atoi(argv[1]) : 4;
+	int nodes = argc > 2 ? atoi(argv[2]) : 1 << 16;
+	unsigned long pops = argc > 3 ? atol(argv[3]) : 1 << 20;
+	int buffer = argc > 4 ? atoi(argv[4]) : 4;
+
+	dfpair(stdout, "threads", "%d", threads);
+	dfpair(stdout, "buffer size", "%d", buffer);
+	dfrowhdr(stdout, "open list", 8, "multiqueue", "queues", "threads",
+			"pops per second", "empty pops", "nodes", "mean rank error",
+			"max rank error");
+	bench<ConcurrentHeap<Elm> >(false, threads, threads, nodes,
+			pops, buffer);
+	for (int c = 2; c <= 8; c *= 2)
+		bench<MultiQueue<Elm> >(true, c * threads, threads, nodes,
+				pops, buffer);
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * simd_bench.cc
+ *
+ * Microbenchmark of the board kernels in tiles_simd.hpp. Checks every
+ * level the CPU supports against the scalar kernels on random boards
+ * and prints the time per state of each kernel.
+ *
+ * usage: simd_bench [nboards] [rounds]
+ */
+
+#include "../tiles_simd.hpp"
+#include "../utils.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+struct Boards {
+	std::vector<char> b16, b25;
+	std::vector<uint64_t> w16;
+	std::vector<uint128_t> w25;
+	std::vector<unsigned int> tbl;
+	int n;
+};
+
+static void random_boards(Boards &bs, int n) {
+	bs.n = n;
+	bs.b16.resize(16 * n);
+	bs.b25.resize(25 * n);
+	for (int i = 0; i < n; ++i) {
+		char *b = &bs.b16[16 * i];
+		for (int j = 0; j < 16; ++j)
+			b[j] = j;
+		std::random_shuffle(b, b + 16);
+		b = &bs.b25[25 * i];
+		for (int j = 0; j < 25; ++j)
+			b[j] = j;
+		std::random_shuffle(b, b + 25);
+	}
+	const TilesKernels *s = tiles_kernels(TilesKernels::SCALAR);
+	bs.w16.resize(n);
+	bs.w25.resize(n);
+	for (int i = 0; i < n; ++i) {
+		bs.w16[i] = s->pack16(&bs.b16[16 * i]);
+		bs.w25[i] = s->pack25(&bs.b25[25 * i]);
+	}
+	bs.tbl.assign(32 * 32, 0);
+	for (int i = 0; i < 25; ++i)
+		for (int j = 0; j < 25; ++j)
+			bs.tbl[i * 32 + j] = random();
+}
+
+// check returns the number of boards on which k disagrees with scalar.
+static int check(const TilesKernels *k, const Boards &bs) {
+	const TilesKernels *s = tiles_kernels(TilesKernels::SCALAR);
+	int bad = 0;
+	for (int i = 0; i < bs.n; ++i) {
+		const char *b16 = &bs.b16[16 * i];
+		const char *b25 = &bs.b25[25 * i];
+		char t[25], u[25];
+		bool ok = k->pack16(b16) == bs.w16[i]
+				&& k->manhattan16(b16) == s->manhattan16(b16)
+				&& k->unpack16(bs.w16[i], t) == s->unpack16(bs.w16[i], u)
+				&& memcmp(t, b16, 16) == 0;
+		ok = ok && k->pack25(b25) == bs.w25[i]
+				&& k->manhattan25(b25) == s->manhattan25(b25)
+				&& k->unpack25(bs.w25[i], t) == s->unpack25(bs.w25[i], u)
+				&& memcmp(t, b25, 25) == 0
+				&& k->xor_hash25(b25, &bs.tbl[0])
+						== s->xor_hash25(b25, &bs.tbl[0]);
+		k->inverse25(b25, t);
+		s->inverse25(b25, u);
+		ok = ok && memcmp(t, u, 25) == 0;
+		if (!ok)
+			++bad;
+	}
+	return bad;
+}
+
+// The sink keeps the compiler from dropping the benchmarked calls.
+static volatile uint64_t sink;
+
+static void bench(const TilesKernels *k, const Boards &bs, int rounds) {
+	char t[25];
+	uint64_t acc = 0;
+	double states = (double) bs.n * rounds;
+	char key[64];
+	double t0;
+
+#define BENCH(label, body) \
+	t0 = walltime(); \
+	for (int r = 0; r < rounds; ++r) \
+		for (int i = 0; i < bs.n; ++i) { \
+			body; \
+		} \
+	snprintf(key, sizeof key, "%s %s ns", k->name, label); \
+	dfpair(stdout, key, "%g", (walltime() - t0) * 1e9 / states);
+
+	BENCH("pack16", acc += k->pack16(&bs.b16[16 * i]))
+	BENCH("unpack16", acc += k->unpack16(bs.w16[i], t) + t[3])
+	BENCH("manhattan16", acc += k->manhattan16(&bs.b16[16 * i]))
+	BENCH("pack25", acc += (uint64_t) k->pack25(&bs.b25[25 * i]))
+	BENCH("unpack25", acc += k->unpack25(bs.w25[i], t) + t[3])
+	BENCH("manhattan25", acc += k->manhattan25(&bs.b25[25 * i]))
+	BENCH("inverse25", k->inverse25(&bs.b25[25 * i], t); acc += t[i % 25])
+	BENCH("xor_hash25", acc += k->xor_hash25(&bs.b25[25 * i], &bs.tbl[0]))
+#undef BENCH
+
+	sink = acc;
+}
+
+int main(int argc, char *argv[]) {
+	int n = argc > 1 ? atoi(argv[1]) : 4096;
+	int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+
+	Boards bs;
+	random_boards(bs, n);
+
+	dfpair(stdout, "selected kernels", "%s", tiles_kernels().name);
+	dfpair(stdout, "boards", "%d", n);
+	dfpair(stdout, "rounds", "%d", rounds);
+
+	TilesKernels::Level levels[] = { TilesKernels::SCALAR, TilesKernels::SSE,
+			TilesKernels::AVX2 };
+	for (int l = 0; l < 3; ++l) {
+		const TilesKernels *k = tiles_kernels(levels[l]);
+		if (!k)
+			continue;
+		char key[64];
+		snprintf(key, sizeof key, "%s mismatches", k->name);
+		dfpair(stdout, key, "%d", check(k, bs));
+		bench(k, bs, rounds);
+	}
+	return 0;
+}
@@ -0,0 +1,345 @@
+/*
+ * bidirectional_hdastar.hpp
+ *
+ * Bidirectional HDA*. Half of the threads search forward from the
+ * initial state and half backward from the goal with the backward
+ * heuristic (front-to-end). Both halves distribute their nodes with the
+ * same hash: partition k is searched forward by thread k and backward
+ * by thread p + k, which share the closed lists of the partition. A
+ * thread that closes a state looks it up in the closed list of the other
+ * direction, so the searches meet on the owner of the state.
+ *
+ * Nodes with f >= U, the cost of the best meeting so far, are pruned.
+ * The search ends once either direction has no node left under U, with
+ * every thread of that direction idle and no node in its buffers
+ * (max(fmin forward, fmin backward) >= U).
+ *
+ * Requires D::goal, D::applybidr and D::unpackbidr (Tiles).
+ */
+
+#ifndef BIDIRECTIONAL_HDASTAR_HPP_
+#define BIDIRECTIONAL_HDASTAR_HPP_
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <pthread.h>
+
+#include "search.hpp"
+#include "utils.hpp"
+#include "fatal.hpp"
+#include "hashtbl.hpp"
+#include "heap.hpp"
+#include "pool.hpp"
+#include "buffer.hpp"
+
+template<class D> class BidirectionalHDAstar: public SearchAlg<D> {
+
+	enum {
+		FORWARD, BACKWARD,
+	};
+
+	struct Node {
+		unsigned int f, g;
+		char pop;
+		int openind;
+		Node *parent;
+		typename D::PackedState packed;
+		HashEntry<Node> hentry;
+
+		bool pred(Node *o) {
+			if (f == o->f)
+				return g > o->g;
+			return f < o->f;
+		}
+
+		void setindex(int i) {
+		}
+
+		const typename D::PackedState &key() {
+			return packed;
+		}
+
+		HashEntry<Node> &hashentry() {
+			return hentry;
+		}
+	};
+
+	// Partition holds the closed lists of both directions for the states
+	// of one hash value. m guards both.
+	struct Partition {
+		HashTable<typename D::PackedState, Node>* closed[2];
+		pthread_mutex_t m;
+	};
+
+	int tnum, p;
+	Partition* partitions;
+	std::vector<Pool<Node>*> nodes; // per thread, freed with the search.
+	buffer<Node>* income_buffer;
+	std::atomic<bool>* idle;
+	std::atomic<unsigned long> sent_nodes[2], received_nodes[2];
+	std::atomic<int> thread_id;
+
+	std::atomic<int> incumbent; // U
+	std::atomic<bool> done;
+	pthread_mutex_t meet_m; // guards meet.
+	Node* meet[2];
+	unsigned long meetings;
+
+	std::vector<unsigned long> expd_distribution;
+	std::vector<unsigned long> gend_distribution;
+	std::vector<unsigned long> duplicates;
+
+	unsigned int openlistsize;
+
+	std::vector<typename D::State> path;
+
+public:
+
+	// tnum must be even: tnum / 2 threads search each way.
+	BidirectionalHDAstar(D &d, int tnum_, unsigned int closedlistsize =
+			110503, unsigned int openlistsize = 100) :
+			SearchAlg<D>(d), tnum(tnum_), p(tnum_ / 2), thread_id(0), incumbent(
+					1000000), done(false), meetings(0), openlistsize(
+					openlistsize) {
+		if (tnum < 2 || tnum % 2 != 0)
+			throw Fatal("BidirectionalHDAstar: needs an even number of threads");
+		partitions = new Partition[p];
+		for (int k = 0; k < p; ++k) {
+			for (int dir = 0; dir < 2; ++dir)
+				partitions[k].closed[dir] = new HashTable<
+						typename D::PackedState, Node>(closedlistsize);
+			pthread_mutex_init(&partitions[k].m, NULL);
+		}
+		for (int i = 0; i < tnum; ++i)
+			nodes.push_back(new Pool<Node>(2048));
+		income_buffer = new buffer<Node> [tnum];
+		idle = new std::atomic<bool>[tnum];
+		for (int i = 0; i < tnum; ++i)
+			idle[i] = false;
+		pthread_mutex_init(&meet_m, NULL);
+		meet[0] = meet[1] = 0;
+		expd_distribution.resize(tnum);
+		gend_distribution.resize(tnum);
+		duplicates.resize(tnum);
+	}
+
+	~BidirectionalHDAstar() {
+		for (int k = 0; k < p; ++k) {
+			delete partitions[k].closed[0];
+			delete partitions[k].closed[1];
+			pthread_mutex_destroy(&partitions[k].m);
+		}
+		delete[] partitions;
+		for (int i = 0; i < tnum; ++i)
+			delete nodes[i];
+		delete[] income_buffer;
+		delete[] idle;
+		pthread_mutex_destroy(&meet_m);
+	}
+
+	std::vector<typename D::State> search(typename D::State &init) {
+		typename D::State goal = this->dom.goal();
+		start(init, FORWARD);
+		start(goal, BACKWARD);
+
+		std::vector<pthread_t> t(tnum);
+		for (int i = 0; i < tnum; ++i)
+			pthread_create(&t[i], NULL, &BidirectionalHDAstar::thread_helper,
+					this);
+		for (int i = 0; i < tnum; ++i)
+			pthread_join(t[i], NULL);
+
+		unsigned long expd[2] = { 0, 0 };
+		for (int i = 0; i < tnum; ++i) {
+			expd[i / p] += expd_distribution[i];
+			this->expd += expd_distribution[i];
+			this->gend += gend_distribution[i];
+			this->dup += duplicates[i];
+		}
+
+		if (meet[FORWARD]) {
+			// Goal first: the backward half reversed, then the forward half.
+			for (Node *q = meet[BACKWARD]->parent; q; q = q->parent) {
+				typename D::State s;
+				this->dom.unpack(s, q->packed);
+				path.push_back(s);
+			}
+			std::reverse(path.begin(), path.end());
+			for (Node *q = meet[FORWARD]; q; q = q->parent) {
+				typename D::State s;
+				this->dom.unpack(s, q->packed);
+				path.push_back(s);
+			}
+		}
+
+		dfpair(stdout, "forward expansions", "%lu", expd[FORWARD]);
+		dfpair(stdout, "backward expansions", "%lu", expd[BACKWARD]);
+		dfpair(stdout, "meetings", "%lu", meetings);
+		return path;
+	}
+
+private:
+
+	void start(typename D::State &s, int dir) {
+		Node* n = nodes[0]->construct();
+		n->g = 0;
+		n->f = this->dom.h(s);
+		n->pop = -1;
+		n->parent = 0;
+		this->dom.pack(n->packed, s);
+		sent_nodes[dir] = 1;
+		received_nodes[dir] = 0;
+		income_buffer[owner(s, dir)].push(n);
+	}
+
+	int owner(const typename D::State &s, int dir) const {
+		return dir * p + this->dom.dist_hash(s) % p;
+	}
+
+	static void* thread_helper(void* arg) {
+		static_cast<BidirectionalHDAstar*>(arg)->thread_search();
+		return 0;
+	}
+
+	void thread_search() {
+		int id = thread_id.fetch_add(1);
+		int dir = id / p;
+		Partition &part = partitions[id % p];
+		Pool<Node> &pool = *nodes[id];
+		Heap<Node> open(openlistsize);
+		std::vector<std::vector<Node*> > outgo_buffer(tnum);
+		std::vector<Node*> tmp;
+		unsigned long expd = 0, gend = 0, dup = 0;
+
+		while (!done) {
+			if (!income_buffer[id].isempty()) {
+				idle[id] = false;
+				if (income_buffer[id].try_lock()) {
+					tmp = income_buffer[id].pull_all_with_lock();
+					received_nodes[dir] += tmp.size();
+					income_buffer[id].release_lock();
+					for (unsigned int i = 0; i < tmp.size(); ++i)
+						open.push(tmp[i]);
+					tmp.clear();
+				}
+			}
+
+			if (open.isempty()) {
+				bool delivered = flush(id, dir, outgo_buffer, 0);
+				idle[id] = delivered;
+				if (delivered && exhausted(dir))
+					done = true;
+				continue;
+			}
+
+			Node *n = open.pop();
+			if (n->f >= (unsigned int) incumbent.load()) {
+				pool.destruct(n);
+				continue;
+			}
+
+			pthread_mutex_lock(&part.m);
+			Node *d = part.closed[dir]->find(n->packed);
+			if (d && d->g <= n->g) {
+				pthread_mutex_unlock(&part.m);
+				pool.destruct(n);
+				++dup;
+				continue;
+			}
+			part.closed[dir]->add(n);
+			Node *other = part.closed[1 - dir]->find(n->packed);
+			pthread_mutex_unlock(&part.m);
+
+			if (other)
+				met(n, other, dir);
+
+			typename D::State state;
+			this->dom.unpackbidr(state, n->packed, dir == BACKWARD);
+			state.h = n->f - n->g;
+			++expd;
+
+			int nops = this->dom.nops(state);
+			for (int i = 0; i < nops; ++i) {
+				int op = this->dom.nthop(state, i);
+				if (op == n->pop)
+					continue;
+				Edge<D> e = this->dom.applybidr(state, op, dir == BACKWARD);
+				unsigned int g = n->g + e.cost;
+				unsigned int f = g + this->dom.h(state);
+				if (f >= (unsigned int) incumbent.load()) {
+					this->dom.undo(state, e);
+					continue;
+				}
+				++gend;
+
+				Node *next = pool.construct();
+				next->g = g;
+				next->f = f;
+				next->pop = e.pop;
+				next->parent = n;
+				this->dom.pack(next->packed, state);
+
+				int o = owner(state, dir);
+				if (o == id)
+					open.push(next);
+				else
+					outgo_buffer[o].push_back(next);
+				this->dom.undo(state, e);
+			}
+			flush(id, dir, outgo_buffer, 32);
+		}
+
+		expd_distribution[id] = expd;
+		gend_distribution[id] = gend;
+		duplicates[id] = dup;
+	}
+
+	// flush sends the outgo buffers holding at least least nodes whose
+	// income buffer is free. Returns true if every buffer is empty.
+	bool flush(int id, int dir, std::vector<std::vector<Node*> > &outgo_buffer,
+			unsigned int least) {
+		bool delivered = true;
+		for (int i = dir * p; i < (dir + 1) * p; ++i) {
+			if (i == id || outgo_buffer[i].empty())
+				continue;
+			if (outgo_buffer[i].size() >= least && income_buffer[i].try_lock()) {
+				sent_nodes[dir] += outgo_buffer[i].size();
+				income_buffer[i].push_all_with_lock(outgo_buffer[i]);
+				income_buffer[i].release_lock();
+				outgo_buffer[i].clear();
+			} else {
+				delivered = false;
+			}
+		}
+		return delivered;
+	}
+
+	// met records the path through n and the node o of the other direction
+	// of the same state if it is the best so far.
+	void met(Node *n, Node *o, int dir) {
+		int cost = n->g + o->g;
+		pthread_mutex_lock(&meet_m);
+		++meetings;
+		if (cost < incumbent) {
+			incumbent = cost;
+			meet[dir] = n;
+			meet[1 - dir] = o;
+		}
+		pthread_mutex_unlock(&meet_m);
+	}
+
+	// exhausted returns true if no node of dir is left under U: every
+	// thread of dir is idle and no node is in their income buffers.
+	// received_nodes is read before the flags and sent_nodes after them.
+	bool exhausted(int dir) {
+		unsigned long received = received_nodes[dir].load();
+		for (int i = dir * p; i < (dir + 1) * p; ++i) {
+			if (!idle[i])
+				return false;
+		}
+		return sent_nodes[dir].load() == received;
+	}
+};
+
+#endif /* BIDIRECTIONAL_HDASTAR_HPP_ */
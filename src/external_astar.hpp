@@ -0,0 +1,674 @@
+/*
+ * external_astar.hpp
+ *
+ * External-memory A* with delayed duplicate detection (Edelkamp, Jabbar
+ * and Schroedl 2004). The open list lives on disk as one file per (g, h)
+ * bucket of packed states (PackedState::stateToChars, RecBytes bytes
+ * each). Buckets are processed in order of f, then g. A bucket is first
+ * made a sorted stream without duplicates: the files written into it are
+ * sorted in runs of mem_records states and merged, and the states found
+ * in the buckets (g - 1, h) and (g - 2, h) are dropped, which removes
+ * every duplicate in an undirected graph with unit costs and a
+ * consistent heuristic. Then its states are expanded by tnum threads,
+ * each appending the children to its own file of the child bucket in
+ * large blocks.
+ *
+ * The search can be restarted: the next bucket is recorded in
+ * dir/progress after each bucket, and a search of the same initial
+ * state started on a directory holding a progress file carries on from
+ * there. Only the bucket files are removed from the directory when the
+ * search ends. A bucket that was being expanded when the search stopped
+ * is expanded again, after the files it was writing are cut back to whole
+ * records; the repeated children are removed when their bucket is sorted.
+ *
+ * The path is rebuilt backwards from the goal by looking up the
+ * predecessors of each state in the sorted buckets of the layer before.
+ */
+
+#ifndef EXTERNAL_ASTAR_HPP_
+#define EXTERNAL_ASTAR_HPP_
+
+#include "search.hpp"
+#include "utils.hpp"
+#include "fatal.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <algorithm>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+template<class D, int RecBytes = 16> class ExternalAstar: public SearchAlg<D> {
+
+	struct Rec {
+		unsigned char b[RecBytes];
+
+		bool operator<(const Rec &o) const {
+			return memcmp(b, o.b, RecBytes) < 0;
+		}
+
+		bool operator==(const Rec &o) const {
+			return memcmp(b, o.b, RecBytes) == 0;
+		}
+	};
+
+	// Reader reads a sorted stream of records from a file, or from
+	// memory if f is 0.
+	struct Reader {
+		ExternalAstar* ea;
+		FILE* f;
+		std::vector<Rec> buf;
+		size_t pos, n;
+
+		Reader(ExternalAstar* ea, FILE* f) :
+				ea(ea), f(f), pos(0), n(0) {
+			if (f)
+				buf.resize(ea->block_records);
+		}
+
+		// next sets r to the next record. Returns false at the end.
+		bool next(Rec &r) {
+			if (pos == n) {
+				if (!f)
+					return false;
+				n = ea->read(&buf[0], buf.size(), f);
+				pos = 0;
+				if (n == 0)
+					return false;
+			}
+			r = buf[pos++];
+			return true;
+		}
+	};
+
+	// Writer appends records to a file in blocks.
+	struct Writer {
+		ExternalAstar* ea;
+		std::string name;
+		std::vector<Rec> buf;
+
+		Writer(ExternalAstar* ea, const std::string &name) :
+				ea(ea), name(name) {
+			buf.reserve(ea->block_records);
+		}
+
+		~Writer() {
+			flush();
+		}
+
+		void push(const Rec &r) {
+			buf.push_back(r);
+			if (buf.size() >= ea->block_records)
+				flush();
+		}
+
+		void flush() {
+			if (buf.empty())
+				return;
+			FILE* f = fopen(name.c_str(), "ab");
+			if (!f)
+				throw Fatal("ExternalAstar: cannot open %s", name.c_str());
+			ea->write(&buf[0], buf.size(), f);
+			fclose(f);
+			buf.clear();
+		}
+	};
+
+	std::string dir;
+	int tnum;
+	unsigned long mem_records; // records sorted in memory at once.
+	unsigned long block_records; // records per read and write.
+
+	ThreadPool pool;
+
+	// The bucket being expanded.
+	int cur_g, cur_h;
+	std::vector<Rec> chunk;
+	std::atomic<unsigned long> chunk_next;
+	std::atomic<int> thread_id;
+	std::atomic<int> maxf; // largest f of a bucket written to.
+	std::vector<unsigned long> expd_distribution, gend_distribution;
+
+	std::atomic<unsigned long> bytes_read, bytes_written;
+	std::vector<double> io_time; // seconds spent in I/O, per thread.
+	double sort_time;
+
+	std::vector<typename D::State> path;
+	Rec init_rec;
+
+public:
+
+	// dir is where the buckets are kept; it is created if needed.
+	ExternalAstar(D &d, const std::string &dir, int tnum = 1,
+			unsigned long mem_records = 1 << 24,
+			unsigned long block_records = 1 << 16) :
+			SearchAlg<D>(d), dir(dir), tnum(tnum), mem_records(mem_records), block_records(
+					block_records), pool(tnum), cur_g(0), cur_h(0), chunk_next(
+					0), thread_id(0), maxf(0), bytes_read(0), bytes_written(0), sort_time(
+					0) {
+		expd_distribution.resize(tnum);
+		gend_distribution.resize(tnum);
+		io_time.resize(tnum + 1); // the last one is the main thread's.
+	}
+
+	std::vector<typename D::State> search(typename D::State &init) {
+		{
+			typename D::PackedState p;
+			this->dom.pack(p, init);
+			if (p.byteSize() != RecBytes)
+				throw Fatal("ExternalAstar: states are %u bytes, not %d",
+						p.byteSize(), RecBytes);
+		}
+
+		double wall0 = walltime();
+		int f0, g0;
+		init_rec = record(init);
+		mkdir(dir.c_str(), 0755);
+		if (load_progress(f0, g0)) {
+			repair_dir();
+			dfpair(stdout, "restarted at f", "%d", f0);
+			dfpair(stdout, "restarted at g", "%d", g0);
+		} else {
+			clear_dir();
+			Writer w(this, bucket(0, this->dom.h(init)));
+			w.push(init_rec);
+			f0 = this->dom.h(init);
+			g0 = 0;
+			maxf = f0;
+			save_progress(f0, 0);
+		}
+
+		int goal_g = -1;
+		typename D::State goal;
+		for (int f = f0; f <= maxf && goal_g < 0; ++f) {
+			for (int g = (f == f0 ? g0 : 0); g <= f && goal_g < 0; ++g) {
+				int h = f - g;
+				if (!sort_bucket(g, h))
+					continue;
+				if (h == 0 && find_goal(g, goal))
+					goal_g = g;
+				else
+					expand_bucket(g, h);
+				save_progress(f, g + 1);
+			}
+		}
+
+		if (goal_g >= 0)
+			rebuild_path(goal, goal_g);
+		clear_dir();
+		unlink((dir + "/progress").c_str());
+
+		double wall = walltime() - wall0;
+		double io = 0;
+		for (unsigned int i = 0; i < io_time.size(); ++i)
+			io += io_time[i];
+		double mb = (bytes_read + bytes_written) / (1024.0 * 1024.0);
+		dfpair(stdout, "MB read", "%g", bytes_read / (1024.0 * 1024.0));
+		dfpair(stdout, "MB written", "%g", bytes_written / (1024.0 * 1024.0));
+		dfpair(stdout, "I/O time (thread sum)", "%g", io);
+		dfpair(stdout, "sort time", "%g", sort_time);
+		dfpair(stdout, "I/O bandwidth (MB/s of I/O time)", "%g",
+				io > 0 ? mb / io : 0);
+		dfpair(stdout, "I/O bandwidth (MB/s of wall time)", "%g",
+				wall > 0 ? mb / wall : 0);
+		return path;
+	}
+
+private:
+
+	std::string bucket(int g, int h) const {
+		char buf[64];
+		snprintf(buf, sizeof buf, "/b%d_%d", g, h);
+		return dir + buf;
+	}
+
+	Rec record(typename D::State &s) const {
+		typename D::PackedState p;
+		this->dom.pack(p, s);
+		Rec r;
+		p.stateToChars(r.b);
+		return r;
+	}
+
+	void state(const Rec &r, typename D::State &s) const {
+		typename D::PackedState p;
+		Rec c = r;
+		p.charsToState(c.b);
+		this->dom.unpack(s, p);
+	}
+
+	size_t read(Rec* buf, size_t n, FILE* f) {
+		double t = walltime();
+		size_t m = fread(buf, sizeof(Rec), n, f);
+		io_time[io_slot()] += walltime() - t;
+		bytes_read += m * sizeof(Rec);
+		return m;
+	}
+
+	void write(const Rec* buf, size_t n, FILE* f) {
+		double t = walltime();
+		if (fwrite(buf, sizeof(Rec), n, f) != n)
+			throw Fatal("ExternalAstar: write failed");
+		io_time[io_slot()] += walltime() - t;
+		bytes_written += n * sizeof(Rec);
+	}
+
+	// io_slot is the io_time entry of the calling thread.
+	int io_slot() {
+		return cur_thread() < 0 ? tnum : cur_thread();
+	}
+
+	static int &cur_thread() {
+		static __thread int id = -1;
+		return id;
+	}
+
+	// files returns the files of the bucket that is named prefix: the
+	// sorted bucket and the runs written into it (prefix.*).
+	std::vector<std::string> files(const std::string &prefix) const {
+		std::vector<std::string> ret;
+		std::string base = prefix.substr(dir.size() + 1);
+		DIR* d = opendir(dir.c_str());
+		if (!d)
+			return ret;
+		struct dirent* e;
+		while ((e = readdir(d))) {
+			std::string n = e->d_name;
+			if (n == base || n.compare(0, base.size() + 1, base + ".") == 0)
+				ret.push_back(dir + "/" + n);
+		}
+		closedir(d);
+		std::sort(ret.begin(), ret.end());
+		return ret;
+	}
+
+	// bucket_file returns true if n is the name of a bucket, b<g>_<h>, or
+	// of a file written into or sorted for one, the bucket name followed
+	// by .run<k>, .srt<k> or .tmp; suffix is set to what follows.
+	static bool bucket_file(const char* n, std::string &suffix) {
+		int g, h, len = -1;
+		if (n[0] != 'b' || !isdigit((unsigned char) n[1])
+				|| sscanf(n, "b%d_%d%n", &g, &h, &len) != 2 || len < 0)
+			return false;
+		const char* s = n + len;
+		suffix = s;
+		if (!*s || strcmp(s, ".tmp") == 0)
+			return true;
+		int k, klen = -1;
+		return (sscanf(s, ".run%d%n", &k, &klen) == 1
+				|| sscanf(s, ".srt%d%n", &k, &klen) == 1) && klen > 0
+				&& !s[klen];
+	}
+
+	// clear_dir removes the bucket files; nothing else in dir is touched.
+	void clear_dir() {
+		DIR* d = opendir(dir.c_str());
+		if (!d)
+			throw Fatal("ExternalAstar: cannot open %s", dir.c_str());
+		struct dirent* e;
+		std::string suffix;
+		while ((e = readdir(d))) {
+			if (bucket_file(e->d_name, suffix))
+				unlink((dir + "/" + e->d_name).c_str());
+		}
+		closedir(d);
+	}
+
+	// repair_dir prepares a restart. A crash may have torn the last record
+	// of a file that is appended to again when its bucket is expanded
+	// again, which would shift every later record off the record boundary,
+	// so the unsorted files are cut to whole records. A .tmp file is an
+	// unfinished sort and goes.
+	void repair_dir() {
+		DIR* d = opendir(dir.c_str());
+		if (!d)
+			throw Fatal("ExternalAstar: cannot open %s", dir.c_str());
+		struct dirent* e;
+		std::string suffix;
+		while ((e = readdir(d))) {
+			if (!bucket_file(e->d_name, suffix) || suffix.empty())
+				continue;
+			std::string name = dir + "/" + e->d_name;
+			struct stat st;
+			if (suffix == ".tmp")
+				unlink(name.c_str());
+			else if (stat(name.c_str(), &st) == 0
+					&& st.st_size % sizeof(Rec) != 0
+					&& truncate(name.c_str(),
+							st.st_size - st.st_size % sizeof(Rec)) != 0)
+				throw Fatal("ExternalAstar: cannot truncate %s", name.c_str());
+		}
+		closedir(d);
+	}
+
+	// load_progress returns false if there is no progress file or it is
+	// of another initial state.
+	bool load_progress(int &f, int &g) {
+		FILE* p = fopen((dir + "/progress").c_str(), "r");
+		if (!p)
+			return false;
+		int m;
+		bool ok = fscanf(p, "%d %d %d", &f, &g, &m) == 3;
+		for (int i = 0; ok && i < RecBytes; ++i) {
+			unsigned int b;
+			ok = fscanf(p, "%2x", &b) == 1 && b == init_rec.b[i];
+		}
+		fclose(p);
+		if (ok)
+			maxf = m;
+		return ok;
+	}
+
+	// save_progress records that the next bucket is (g, f - g).
+	void save_progress(int f, int g) {
+		std::string tmp = dir + "/progress.tmp";
+		FILE* p = fopen(tmp.c_str(), "w");
+		if (!p)
+			throw Fatal("ExternalAstar: cannot write %s", tmp.c_str());
+		fprintf(p, "%d %d %d ", f, g, maxf.load());
+		for (int i = 0; i < RecBytes; ++i)
+			fprintf(p, "%02x", init_rec.b[i]);
+		fprintf(p, "\n");
+		fclose(p);
+		rename(tmp.c_str(), (dir + "/progress").c_str());
+	}
+
+	// sort_bucket turns the files of bucket (g, h) into one sorted file
+	// without duplicates or states of (g - 1, h) and (g - 2, h).
+	// Returns false if the bucket is empty.
+	bool sort_bucket(int g, int h) {
+		std::string name = bucket(g, h);
+		std::vector<std::string> in = files(name);
+		if (in.empty())
+			return false;
+
+		double t0 = walltime();
+		std::vector<std::string> runs;
+		std::vector<Rec> mem;
+		mem.reserve(std::min(mem_records, 1ul << 20));
+		std::vector<Rec> buf(block_records);
+		for (unsigned int i = 0; i < in.size(); ++i) {
+			FILE* f = fopen(in[i].c_str(), "rb");
+			if (!f)
+				throw Fatal("ExternalAstar: cannot open %s", in[i].c_str());
+			size_t n;
+			// Files were cut to whole records by repair_dir.
+			while ((n = read(&buf[0], buf.size(), f)) > 0) {
+				mem.insert(mem.end(), buf.begin(), buf.begin() + n);
+				if (mem.size() >= mem_records) {
+					runs.push_back(write_run(name, runs.size(), mem));
+					mem.clear();
+				}
+			}
+			fclose(f);
+		}
+		std::sort(mem.begin(), mem.end());
+		mem.erase(std::unique(mem.begin(), mem.end()), mem.end());
+
+		std::vector<Reader*> src;
+		std::vector<FILE*> open;
+		src.push_back(new Reader(this, 0));
+		src.back()->buf.swap(mem);
+		src.back()->n = src.back()->buf.size();
+		for (unsigned int i = 0; i < runs.size(); ++i) {
+			FILE* f = fopen(runs[i].c_str(), "rb");
+			if (!f)
+				throw Fatal("ExternalAstar: cannot open %s", runs[i].c_str());
+			open.push_back(f);
+			src.push_back(new Reader(this, f));
+		}
+
+		// States already in the two layers before.
+		std::vector<Reader*> sub;
+		for (int d = 1; d <= 2 && g - d >= 0; ++d) {
+			FILE* f = fopen(bucket(g - d, h).c_str(), "rb");
+			if (f) {
+				open.push_back(f);
+				sub.push_back(new Reader(this, f));
+			}
+		}
+
+		std::string tmp = name + ".tmp";
+		unlink(tmp.c_str());
+		unsigned long count = merge(src, sub, tmp);
+
+		for (unsigned int i = 0; i < src.size(); ++i)
+			delete src[i];
+		for (unsigned int i = 0; i < sub.size(); ++i)
+			delete sub[i];
+		for (unsigned int i = 0; i < open.size(); ++i)
+			fclose(open[i]);
+
+		// The sorted file replaces the bucket; then the inputs go.
+		rename(tmp.c_str(), name.c_str());
+		for (unsigned int i = 0; i < in.size(); ++i)
+			if (in[i] != name)
+				unlink(in[i].c_str());
+		for (unsigned int i = 0; i < runs.size(); ++i)
+			unlink(runs[i].c_str());
+
+		sort_time += walltime() - t0;
+		return count > 0;
+	}
+
+	std::string write_run(const std::string &name, int k, std::vector<Rec> &mem) {
+		std::sort(mem.begin(), mem.end());
+		mem.erase(std::unique(mem.begin(), mem.end()), mem.end());
+		char suffix[32];
+		snprintf(suffix, sizeof suffix, ".srt%d", k);
+		std::string run = name + suffix;
+		FILE* f = fopen(run.c_str(), "wb");
+		if (!f)
+			throw Fatal("ExternalAstar: cannot open %s", run.c_str());
+		write(&mem[0], mem.size(), f);
+		fclose(f);
+		return run;
+	}
+
+	struct Head {
+		Rec r;
+		int src;
+		bool operator<(const Head &o) const {
+			return o.r < r; // min-heap
+		}
+	};
+
+	// merge writes the union of the sorted streams src minus the sorted
+	// streams sub to out, without duplicates. Returns the records written.
+	unsigned long merge(std::vector<Reader*> &src, std::vector<Reader*> &sub,
+			const std::string &out) {
+		std::priority_queue<Head> heads;
+		for (unsigned int i = 0; i < src.size(); ++i) {
+			Head h;
+			h.src = i;
+			if (src[i]->next(h.r))
+				heads.push(h);
+		}
+		std::vector<Rec> subr(sub.size());
+		std::vector<bool> subok(sub.size());
+		for (unsigned int i = 0; i < sub.size(); ++i)
+			subok[i] = sub[i]->next(subr[i]);
+
+		unsigned long count = 0;
+		{
+			Writer w(this, out);
+			bool first = true;
+			Rec last;
+			while (!heads.empty()) {
+				Head h = heads.top();
+				heads.pop();
+				Rec r = h.r;
+				if (src[h.src]->next(h.r))
+					heads.push(h);
+				if (!first && r == last)
+					continue;
+				first = false;
+				last = r;
+
+				bool dup = false;
+				for (unsigned int i = 0; i < sub.size(); ++i) {
+					while (subok[i] && subr[i] < r)
+						subok[i] = sub[i]->next(subr[i]);
+					if (subok[i] && subr[i] == r)
+						dup = true;
+				}
+				if (!dup) {
+					w.push(r);
+					++count;
+				}
+			}
+		}
+		if (count == 0) {
+			FILE* f = fopen(out.c_str(), "wb"); // an empty bucket
+			if (f)
+				fclose(f);
+		}
+		return count;
+	}
+
+	bool find_goal(int g, typename D::State &goal) {
+		FILE* f = fopen(bucket(g, 0).c_str(), "rb");
+		if (!f)
+			return false;
+		std::vector<Rec> buf(block_records);
+		size_t n;
+		bool found = false;
+		while (!found && (n = read(&buf[0], buf.size(), f)) > 0) {
+			for (size_t i = 0; i < n && !found; ++i) {
+				state(buf[i], goal);
+				found = this->dom.isgoal(goal);
+			}
+		}
+		fclose(f);
+		return found;
+	}
+
+	// expand_bucket expands bucket (g, h), mem_records states at a time.
+	void expand_bucket(int g, int h) {
+		cur_g = g;
+		cur_h = h;
+		FILE* f = fopen(bucket(g, h).c_str(), "rb");
+		if (!f)
+			return;
+		chunk.resize(std::min(mem_records, 1ul << 22));
+		size_t n;
+		while ((n = read(&chunk[0], chunk.size(), f)) > 0) {
+			chunk.resize(n);
+			chunk_next = 0;
+			thread_id = 0;
+			pool.run(tnum, &ExternalAstar::expand_helper, this);
+			for (int i = 0; i < tnum; ++i) {
+				this->expd += expd_distribution[i];
+				this->gend += gend_distribution[i];
+				expd_distribution[i] = 0;
+				gend_distribution[i] = 0;
+			}
+			chunk.resize(std::min(mem_records, 1ul << 22));
+		}
+		fclose(f);
+	}
+
+	static void* expand_helper(void* arg) {
+		static_cast<ExternalAstar*>(arg)->expand_chunk();
+		return 0;
+	}
+
+	void expand_chunk() {
+		int id = thread_id.fetch_add(1);
+		cur_thread() = id;
+		char suffix[32];
+		snprintf(suffix, sizeof suffix, ".run%d", id);
+
+		// Writers of the child buckets by h.
+		std::vector<Writer*> out;
+		unsigned long expd = 0, gend = 0;
+		const unsigned long grain = 4096;
+		typename D::State s;
+		for (unsigned long b = chunk_next.fetch_add(grain); b < chunk.size();
+				b = chunk_next.fetch_add(grain)) {
+			unsigned long e = std::min(b + grain, (unsigned long) chunk.size());
+			for (unsigned long i = b; i < e; ++i) {
+				state(chunk[i], s);
+				++expd;
+				int nops = this->dom.nops(s);
+				for (int k = 0; k < nops; ++k) {
+					Edge<D> edge = this->dom.apply(s, this->dom.nthop(s, k));
+					int ch = this->dom.h(s);
+					if ((int) out.size() <= ch)
+						out.resize(ch + 1, 0);
+					if (!out[ch])
+						out[ch] = new Writer(this,
+								bucket(cur_g + edge.cost, ch) + suffix);
+					out[ch]->push(record(s));
+					++gend;
+					int f = cur_g + edge.cost + ch;
+					int m = maxf.load();
+					while (f > m && !maxf.compare_exchange_weak(m, f))
+						;
+					this->dom.undo(s, edge);
+				}
+			}
+		}
+		for (unsigned int i = 0; i < out.size(); ++i)
+			delete out[i];
+		expd_distribution[id] = expd;
+		gend_distribution[id] = gend;
+		cur_thread() = -1;
+	}
+
+	// contains returns true if the sorted bucket (g, h) holds r.
+	bool contains(int g, int h, const Rec &r) {
+		FILE* f = fopen(bucket(g, h).c_str(), "rb");
+		if (!f)
+			return false;
+		fseek(f, 0, SEEK_END);
+		long lo = 0, hi = ftell(f) / sizeof(Rec);
+		bool found = false;
+		while (lo < hi && !found) {
+			long mid = (lo + hi) / 2;
+			Rec m;
+			fseek(f, mid * sizeof(Rec), SEEK_SET);
+			if (read(&m, 1, f) != 1)
+				break;
+			if (m == r)
+				found = true;
+			else if (m < r)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		fclose(f);
+		return found;
+	}
+
+	void rebuild_path(typename D::State goal, int g) {
+		path.push_back(goal);
+		typename D::State s = goal;
+		while (g > 0) {
+			bool found = false;
+			int nops = this->dom.nops(s);
+			for (int k = 0; k < nops && !found; ++k) {
+				Edge<D> e = this->dom.apply(s, this->dom.nthop(s, k));
+				if (contains(g - e.cost, this->dom.h(s), record(s))) {
+					path.push_back(s);
+					g -= e.cost;
+					found = true;
+				} else {
+					this->dom.undo(s, e);
+				}
+			}
+			if (!found)
+				throw Fatal("ExternalAstar: no predecessor at g = %d", g);
+		}
+	}
+};
+
+#endif /* EXTERNAL_ASTAR_HPP_ */
@@ -0,0 +1,270 @@
+/*
+ * frontier_astar.hpp
+ *
+ * Frontier A* (Korf, Zhang, Thayer and Hohwald 2005). Only the open
+ * nodes are kept. Each open node has a bit per operator (in nthop
+ * order) which is set once the neighbor that operator leads to has
+ * been generated from it, and the operator is not applied when the
+ * node is expanded. With a consistent heuristic and reversible
+ * operators this keeps closed nodes from being generated again, so
+ * expanded nodes are freed right away.
+ *
+ * Without parent pointers the path is rebuilt by divide and conquer.
+ * Every node carries a relay: the pair of adjacent nodes on its path
+ * where g crosses the middle of the search. Once the goal is found,
+ * the two halves are solved by searching from the start to the first
+ * relay node and from the second relay node to the goal, recursively,
+ * with the same heuristic and the cost of the solution as the f bound.
+ */
+
+#ifndef FRONTIER_ASTAR_HPP_
+#define FRONTIER_ASTAR_HPP_
+
+#include "search.hpp"
+#include "utils.hpp"
+#include "hashtbl.hpp"
+#include "heap.hpp"
+#include "pool.hpp"
+
+#include <vector>
+#include <algorithm>
+
+template<class D> class FrontierAstar: public SearchAlg<D> {
+
+	struct Node {
+		unsigned int f, g;
+		unsigned char used; // operators not to apply, by nthop index.
+		int openind;
+		int relay; // index in relays, -1 if g has not crossed the middle.
+		typename D::PackedState packed;
+		HashEntry<Node> hentry;
+
+		bool pred(Node *o) {
+			if (f == o->f)
+				return g > o->g;
+			return f < o->f;
+		}
+
+		void setindex(int i) {
+		}
+
+		const typename D::PackedState &key() {
+			return packed;
+		}
+
+		HashEntry<Node> &hashentry() {
+			return hentry;
+		}
+	};
+
+	// Relay is an edge a -> b on the path to a node with g(a) < middle
+	// <= g(b).
+	struct Relay {
+		typename D::PackedState a, b;
+		unsigned int ga, gb;
+	};
+
+	HashTable<typename D::PackedState, Node> frontier;
+	Heap<Node> open;
+	Pool<Node> nodes;
+	std::vector<Relay> relays;
+
+	std::vector<typename D::State> path;
+
+	unsigned int opensize;
+	unsigned long frontier_size, max_frontier;
+	unsigned int nsearches;
+
+public:
+
+	FrontierAstar(D &d, unsigned int opensize = 120,
+			unsigned int frontiersize = 14414443) :
+			SearchAlg<D>(d), frontier(frontiersize), open(opensize), opensize(
+					opensize), frontier_size(0), max_frontier(0), nsearches(0) {
+	}
+
+	std::vector<typename D::State> search(typename D::State &init) {
+		typename D::PackedState s, goal;
+		this->dom.pack(s, init);
+
+		unsigned int cost;
+		Relay r;
+		if (!astar(s, 0, 0, ~0u, goal, cost, r))
+			return path;
+		unsigned long top_expd = this->expd;
+
+		std::vector<typename D::PackedState> packed;
+		if (cost == 0) {
+			packed.push_back(s);
+		} else {
+			segment(s, r.a, r.ga, cost, packed);
+			segment(r.b, goal, cost - r.gb, cost - r.gb, packed);
+		}
+
+		// Goal first, as Astar returns it.
+		for (int i = packed.size() - 1; i >= 0; --i) {
+			typename D::State st;
+			this->dom.unpack(st, packed[i]);
+			path.push_back(st);
+		}
+
+		dfpair(stdout, "nodes expanded by the first search", "%lu", top_expd);
+		dfpair(stdout, "max frontier size", "%lu", max_frontier);
+		dfpair(stdout, "number of searches", "%u", nsearches);
+		return path;
+	}
+
+private:
+
+	// segment appends the path from s to t, both included. t is tg away
+	// from s, and no node on the path has g + h > fbound (with g from s).
+	void segment(const typename D::PackedState &s,
+			const typename D::PackedState &t, unsigned int tg,
+			unsigned int fbound, std::vector<typename D::PackedState> &out) {
+		if (s.eq(t)) {
+			out.push_back(s);
+			return;
+		}
+		typename D::PackedState found;
+		unsigned int g;
+		Relay r;
+		if (!astar(s, &t, tg, fbound, found, g, r))
+			throw Fatal("FrontierAstar: lost the path to a relay node");
+		segment(s, r.a, r.ga, fbound, out);
+		segment(r.b, t, tg - r.gb, fbound - r.gb, out);
+	}
+
+	// astar searches from s for target, or for a goal if target is 0.
+	// Nodes with g > tg (with a target) or g + h > fbound are pruned.
+	// It returns the node found, its g and its relay.
+	bool astar(const typename D::PackedState &s,
+			const typename D::PackedState *target, unsigned int tg,
+			unsigned int fbound, typename D::PackedState &found,
+			unsigned int &cost, Relay &relay) {
+		++nsearches;
+		relays.clear();
+
+		typename D::State state;
+		this->dom.unpack(state, s);
+
+		unsigned int mid = target ? tg / 2 : this->dom.h(state) / 2;
+		if (mid == 0)
+			mid = 1;
+
+		Node* root = nodes.construct();
+		root->g = 0;
+		root->f = this->dom.h(state);
+		root->used = 0;
+		root->relay = -1;
+		root->packed = s;
+		frontier.add(root);
+		push(root);
+		frontier_size = 1;
+
+		bool solved = false;
+		while (!open.isempty()) {
+			Node *n = open.pop();
+			this->dom.unpack(state, n->packed);
+
+			if (target ? n->packed.eq(*target) : this->dom.isgoal(state)) {
+				found = n->packed;
+				cost = n->g;
+				if (n->g > 0) {
+					if (n->relay < 0)
+						throw Fatal("FrontierAstar: no relay (inconsistent h?)");
+					relay = relays[n->relay];
+				}
+				frontier.remove(n);
+				--frontier_size;
+				solved = true;
+				break;
+			}
+
+			frontier.remove(n);
+			--frontier_size;
+			this->expd++;
+
+			int nops = this->dom.nops(state);
+			for (int i = 0; i < nops; i++) {
+				if (n->used & (1 << i))
+					continue;
+				int op = this->dom.nthop(state, i);
+				Edge<D> e = this->dom.apply(state, op);
+				unsigned int g = n->g + e.cost;
+				unsigned int f = g + this->dom.h(state);
+
+				// The operator of the child back to n.
+				int back = 0;
+				int cops = this->dom.nops(state);
+				while (back < cops && this->dom.nthop(state, back) != e.pop)
+					++back;
+
+				// An open child is marked even if pruned, or it would
+				// generate n again.
+				typename D::PackedState packed;
+				this->dom.pack(packed, state);
+				Node *c = frontier.find(packed);
+				if (c)
+					c->used |= 1 << back;
+				if ((target && g > tg) || f > fbound) {
+					this->dom.undo(state, e);
+					continue;
+				}
+				this->gend++;
+
+				if (c) {
+					if (g < c->g) {
+						open.pre_update(c);
+						c->g = g;
+						c->f = f;
+						c->relay = relay_of(n, c, mid);
+						open.post_update(c);
+					}
+				} else {
+					c = nodes.construct();
+					c->g = g;
+					c->f = f;
+					c->used = 1 << back;
+					c->packed = packed;
+					c->relay = relay_of(n, c, mid);
+					frontier.add(c);
+					push(c);
+					if (++frontier_size > max_frontier)
+						max_frontier = frontier_size;
+				}
+				this->dom.undo(state, e);
+			}
+			nodes.destruct(n);
+		}
+
+		while (!open.isempty())
+			frontier.remove(open.pop());
+		frontier_size = 0;
+		nodes.reset();
+		return solved;
+	}
+
+	// push adds n to open, which would silently drop it if f were beyond
+	// its size.
+	void push(Node *n) {
+		if (n->f >= opensize)
+			throw Fatal("FrontierAstar: f = %u is over the open list size %u",
+					n->f, opensize);
+		open.push(n);
+	}
+
+	// relay_of returns the relay of the child c of n.
+	int relay_of(Node *n, Node *c, unsigned int mid) {
+		if (n->g >= mid || c->g < mid)
+			return n->relay;
+		Relay r;
+		r.a = n->packed;
+		r.b = c->packed;
+		r.ga = n->g;
+		r.gb = c->g;
+		relays.push_back(r);
+		return relays.size() - 1;
+	}
+};
+
+#endif /* FRONTIER_ASTAR_HPP_ */
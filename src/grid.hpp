@@ -9,6 +9,7 @@
 #include <cassert>
 #include <stdint.h>
 #include <iostream>
+#include <vector>
 
 struct Grid {
 	enum {
@@ -35,6 +36,24 @@ struct Grid {
 		bool eq(const PackedState &h) const {
 			return word == h.word;
 		}
+
+		unsigned int byteSize() const {
+			return 8;
+		}
+
+		void stateToChars(unsigned char* d) const {
+			int n = sizeof word;
+			for (int y = 0; n-- > 0; y++)
+				d[y] = (word >> (n * 8)) & 0xff;
+		}
+
+		void charsToState(unsigned char* d) {
+			int n = sizeof word;
+			word = 0;
+			for (int i = 0; i < n; ++i) {
+				word += (uint64_t) d[i] << (8 * (n - i - 1));
+			}
+		}
 	};
 
 	// Tiles constructs a new instance by reading
@@ -126,6 +145,13 @@ struct Grid {
 
 	}
 
+	std::vector<unsigned int> ops(const State &s) const {
+		std::vector<unsigned int> ret;
+		for (int i = 0; i < nops(s); ++i)
+			ret.push_back(nthop(s, i));
+		return ret;
+	}
+
 	// Operation and the value of h.
 	struct Undo {
 		int h, op;
@@ -174,19 +200,25 @@ struct Grid {
 
 	// TODO
 	void pack(PackedState &dst, State &s) const {
-		dst.word = s.x * total_width + s.y;
+		dst.word = s.x * total_height + s.y;
 	}
 
 	// TODO
 	// unpack unpacks the packed state s into the state dst.
 	void unpack(State &dst, PackedState s) const {
-		dst.x = s.word / total_width;
-		dst.y = s.word % total_width;
+		dst.x = s.word / total_height;
+		dst.y = s.word % total_height;
 		dst.h = mdist(dst, goal);
 		dst.blank = dst.x * 100000 + dst.y;
 
 	}
 
+	// dist_hash distributes the cells over the threads of HDA*.
+	unsigned int dist_hash(const State &s) const {
+		uint64_t w = (uint64_t) s.x * total_height + s.y;
+		return (w * 0x9E3779B97F4A7C15ULL) >> 32;
+	}
+
 	void set_weight(double weight_) {
 		this->weight = weight_;
 	}
@@ -206,7 +238,7 @@ private:
 
 	// mdist returns the Manhattan distance of the given tile array.
 	int mdist(const State from, const State to) const {
-		return abs(from.x - to.x) + abs(from.y - to.y);
+		return abs((int) from.x - (int) to.x) + abs((int) from.y - (int) to.y);
 	}
 
 	unsigned int initx;
@@ -5,6 +5,7 @@
 #define _HASHTBL_HPP_
 
 #include <vector>
+#include <algorithm>
 #include <stdio.h>
 #include <pthread.h>
 #include <iostream>
@@ -34,6 +35,11 @@ public:
 //		pthread_mutex_init(&m, NULL);
 	}
 
+	// clear empties the table without touching the nodes.
+	void clear() {
+		std::fill(buckets.begin(), buckets.end(), (Node*) 0);
+	}
+
 	void destruct_all(Pool<Node>& nodes) {
 		for (int i = 0; i < buckets.size(); ++i) {
 			Node* n = buckets[i];
@@ -90,6 +96,24 @@ public:
 		return p;
 	}
 
+	// for_each calls f on every node, bucket by bucket, each bucket from
+	// the most recently added node.
+	template<class F> void for_each(F f) {
+		for (unsigned int i = 0; i < buckets.size(); ++i)
+			for (Node *p = buckets[i]; p; p = p->hashentry().next)
+				f(p);
+	}
+
+	// remove removes n from the hash table.
+	void remove(Node *n) {
+		unsigned int ind = n->hashentry().hash % buckets.size();
+		Node **p = &buckets[ind];
+		while (*p && *p != n)
+			p = &(*p)->hashentry().next;
+		if (*p)
+			*p = n->hashentry().next;
+	}
+
 	// add adds a value to the hash table.
 	// it will insert the node in front of the list.
 	void add(Node *n) {
@@ -15,6 +15,11 @@
 #include <math.h>
 #include <algorithm>
 #include <array>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
 
 #include "search.hpp"
 #include "utils.hpp"
@@ -22,21 +27,58 @@
 #include "heap.hpp"
 #include "pool.hpp"
 #include "buffer.hpp"
+#include "fatal.hpp"
 
 #include "naive_heap.hpp"
 
 #include "zobrist.hpp"
 #include "trivial_hash.hpp"
 #include "random_hash.hpp"
+#include "thread_pool.hpp"
+#include "shared_incumbent.hpp"
 
 // DELAY 10,000,000 -> 3000 nodes per second
 //#define DELAY 0
 
+// BATCH_EXPANSION n expands the popped nodes n at a time so that the
+// heuristic lookups of all their children can be prefetched together.
+// Requires D::apply_lazy and D::heuristic_batch (Tiles24).
+//#define BATCH_EXPANSION 16
+
+// PACKED_EXPANSION generates children directly from the packed parent
+// without unpacking it. The node carries the blank position, h is f - g
+// and the Zobrist value is updated incrementally.
+// Requires D::apply_packed (Tiles).
+//#define PACKED_EXPANSION
+
+// PARTIAL_EXPANSION is enhanced partial expansion A* (EPEA*, Felner et
+// al. 2012). A node is generated with its f as the stored value F. An
+// expansion generates only the children with f = F, chosen by
+// D::delta_f without generating the others, and puts the node back with
+// F = f + the next larger delta_f, if any. Requires D::delta_f (Tiles).
+//#define PARTIAL_EXPANSION
+
+#if defined(BATCH_EXPANSION) && defined(PACKED_EXPANSION)
+#error "BATCH_EXPANSION and PACKED_EXPANSION are exclusive"
+#endif
+#if defined(PARTIAL_EXPANSION) && (defined(BATCH_EXPANSION) || defined(PACKED_EXPANSION))
+#error "PARTIAL_EXPANSION needs the default expansion"
+#endif
+
+template<class D> class MBHDAstar;
+
 template<class D> class HDAstar: public SearchAlg<D> {
+	friend class MBHDAstar<D>;
 
 	struct Node {
 		unsigned int f, g;
 		char pop;
+#ifdef PACKED_EXPANSION
+		char blank;
+#endif
+#ifdef PARTIAL_EXPANSION
+		bool expanded; // in the closed list, put back to open.
+#endif
 		unsigned int zbr; // zobrist value. stored here for now. Also the size is char for now.
 		int openind;
 //		char thrown; // How many times this node has been outsourced.
@@ -63,6 +105,35 @@ template<class D> class HDAstar: public SearchAlg<D> {
 		}
 	};
 
+public:
+	// Arena holds the closed list and node pool of each thread. A search
+	// given an arena clears and reuses them instead of allocating its
+	// own, so that a batch of searches allocates them once (batch.hpp).
+	struct Arena {
+		std::vector<HashTable<typename D::PackedState, Node>*> closed;
+		std::vector<Pool<Node>*> nodes;
+
+		Arena(int tnum, unsigned int closedlistsize) {
+			for (int i = 0; i < tnum; ++i) {
+				closed.push_back(
+						new HashTable<typename D::PackedState, Node>(
+								closedlistsize));
+				nodes.push_back(new Pool<Node>(2048));
+			}
+		}
+
+		~Arena() {
+			for (unsigned int i = 0; i < closed.size(); ++i) {
+				delete closed[i];
+				delete nodes[i];
+			}
+		}
+	};
+
+private:
+	Arena* arena = 0;
+	ThreadPool* pool = 0; // threads to run on instead of creating them.
+
 	buffer<Node>* income_buffer;
 	std::vector<typename D::State> path;
 	typename D::State init;
@@ -70,7 +141,9 @@ template<class D> class HDAstar: public SearchAlg<D> {
 	std::atomic<int> thread_id; // set thread id for zobrist hashing.
 
 	std::atomic<int> incumbent; // The best solution so far.
-	bool* terminate;
+	std::atomic<bool>* terminate;
+	std::atomic<unsigned long> sent_nodes; // pushed into income buffers
+	std::atomic<unsigned long> received_nodes; // pulled from income buffers
 
 	int income_threshold;
 	int outgo_threshold;
@@ -99,8 +172,9 @@ template<class D> class HDAstar: public SearchAlg<D> {
 	struct LogIncumbent {
 		double walltime;
 		int incumbent;
-		LogIncumbent(double walltime_, int incumbent_) :
-				walltime(walltime_), incumbent(incumbent_) {
+		int bound; // lower bound of the optimal cost.
+		LogIncumbent(double walltime_, int incumbent_, int bound_ = -1) :
+				walltime(walltime_), incumbent(incumbent_), bound(bound_) {
 		}
 		;
 	};
@@ -108,35 +182,37 @@ template<class D> class HDAstar: public SearchAlg<D> {
 
 	struct LogNodeOrder {
 		int globalOrder;
-		uint64_t packedState;
+		typename D::PackedState packedState;
 		int fvalue;
 		int openlistSize;
-		LogNodeOrder(int globalOrder_, char* tiles, int fvalue_ = -1,
-				int openlistSize_ = -1) :
-				globalOrder(globalOrder_), fvalue(fvalue_), openlistSize(
+		LogNodeOrder(int globalOrder_, const typename D::PackedState& packed,
+				int fvalue_ = -1, int openlistSize_ = -1) :
+				globalOrder(globalOrder_), packedState(packed), fvalue(fvalue_), openlistSize(
 						openlistSize_) {
-			packedState = pack(tiles);
-		}
-		uint64_t pack(char* tiles) {
-			uint64_t word = 0; // to make g++ shut up about uninitialized usage.
-			for (int i = 0; i < D::Ntiles; i++) {
-				word = (word << 4) | tiles[i];
-			}
-			return word;
 		}
-		char* unpack() {
-			uint64_t word = packedState;
-			char* tiles = new char[D::Ntiles];
-			for (int i = D::Ntiles - 1; i >= 0; i--) {
-				int t = word & 0xF; // 15 Puzzle specific
-				word >>= 4;
-				tiles[i] = t;
+		// print prints the packed state as hex, most significant byte first.
+		void print(FILE* out) const {
+			std::vector<unsigned char> bytes(packedState.byteSize());
+			packedState.stateToChars(&bytes[0]);
+			for (unsigned int i = 0; i < packedState.byteSize(); ++i) {
+				fprintf(out, "%02x", bytes[i]);
 			}
-			return tiles;
 		}
 	};
 	std::vector<LogNodeOrder>* lognodeorder;
 
+#ifdef BATCH_EXPANSION
+	// Batch holds the nodes a thread has popped but not yet expanded,
+	// and the children generated from them.
+	struct Batch {
+		std::vector<Node*> nodes;
+		std::vector<typename D::State> states;
+		std::vector<typename D::State> kids;
+		std::vector<Node*> parents;
+		std::vector<Edge<D> > edges;
+	};
+#endif
+
 	double wall0 = 0; // ANALYZE_FTRACE
 
 	int* open_sizes;
@@ -170,8 +246,51 @@ template<class D> class HDAstar: public SearchAlg<D> {
 	unsigned int openlistsize;
 	unsigned int initmaxcost;
 
+#ifdef PARTIAL_EXPANSION
+	std::atomic<unsigned long> reinserted; // partially expanded nodes put back
+#endif
+
 	pthread_barrier_t barrier; // used for estimation with timer limits
 
+	// Anytime mode (set_anytime). Each pass searches with f = g + w * h
+	// until no open node is under the incumbent, then the next weight
+	// rekeys the open lists and the search goes on from them.
+	std::vector<double> weights;
+	double weight = 1.0;
+	unsigned int pass = 0;
+	bool anytime_done = false;
+	std::atomic<bool> stop_anytime;
+	std::atomic<int> anytime_bound; // min g + h over the open lists.
+
+	// Memory budget (set_memory_budget). Once a thread's node pool holds
+	// more than its share, every thread stops and leaves its open list
+	// and the nodes sent to it in frozen[id] (mbhdastar.hpp).
+	unsigned long memory_budget = 0;
+	std::atomic<bool> freeze;
+	std::vector<std::vector<Node*> > frozen;
+
+	// Checkpointing (set_checkpoint, resume). Thread 0 moves run_state
+	// from RUN to CHECKPOINT, and every thread then writes its share of
+	// a checkpoint (write_checkpoint). A thread that would stop moves it
+	// to DONE first, so that a checkpoint is never begun by some threads
+	// only.
+	enum {
+		RUN, CHECKPOINT, DONE,
+	};
+	std::atomic<int> run_state;
+	std::atomic<bool> checkpoint_requested;
+	std::string checkpoint_file;
+	double checkpoint_interval = 0;
+	double last_checkpoint = 0;
+	unsigned int checkpoint_gen = 0;
+	std::vector<unsigned long> checkpoint_count; // closed nodes per thread
+	std::vector<std::vector<Node*> > resumed_closed, resumed_open;
+	std::unique_ptr<Pool<Node> > resumed_nodes;
+	bool resumed = false;
+	int resumed_incumbent = 0;
+	unsigned long resumed_expd = 0, resumed_gend = 0, resumed_dup = 0;
+	std::vector<typename D::State> resumed_path;
+
 public:
 
 	HDAstar(D &d, int tnum_, int income_threshold_ = 1000000,
@@ -185,7 +304,7 @@ public:
 					0), overrun(overrun_), closedlistsize(closedlistsize),
 					openlistsize(openlistsize), initmaxcost(maxcost), isFIFO(isFIFO) {
 		income_buffer = new buffer<Node> [tnum];
-		terminate = new bool[tnum];
+		terminate = new std::atomic<bool>[tnum];
 		for (int i = 0; i < tnum; ++i) {
 			terminate[i] = 0;
 		}
@@ -205,12 +324,189 @@ public:
 		lognodeorder = new std::vector<LogNodeOrder>[tnum];
 
 		open_sizes = new int[tnum];
+
+		run_state = RUN;
+		checkpoint_requested = false;
+		checkpoint_count.resize(tnum);
+	}
+
+	~HDAstar() {
+		delete[] income_buffer;
+		delete[] terminate;
+		delete[] fvalues;
+		delete[] logfvalue;
+		delete[] logincumbent;
+		delete[] lognodeorder;
+		delete[] open_sizes;
 	}
 
 	void set_closedlistsize(unsigned int closedlistsize) {
 		this->closedlistsize = closedlistsize;
 	}
 
+	// The arena must have at least tnum threads.
+	void set_arena(Arena* arena) {
+		this->arena = arena;
+	}
+
+	// The pool must have tnum idle threads when search is called.
+	void set_thread_pool(ThreadPool* pool) {
+		this->pool = pool;
+	}
+
+	// set_memory_budget stops the search once the node pools hold more
+	// than bytes in total; frozen() then holds the open nodes. Search
+	// with an arena to keep the nodes after search returns.
+	void set_memory_budget(unsigned long bytes) {
+#ifdef BATCH_EXPANSION
+		throw Fatal("HDAstar: memory budget needs the default expansion");
+#endif
+		memory_budget = bytes;
+	}
+
+	bool frozen_open() const {
+		return freeze;
+	}
+
+	// set_anytime makes the search anytime weighted HDA* with the weights
+	// w0, w0 - step, ..., 1. A node reached with a smaller g than its
+	// closed copy is reopened, and nodes with g + h >= incumbent are
+	// pruned. Every solution and the end of every pass are logged as
+	// (time, cost, lower bound). The open list size must exceed
+	// w0 times the largest h.
+	void set_anytime(double w0, double step) {
+#if defined(BATCH_EXPANSION) || defined(PACKED_EXPANSION) || defined(PARTIAL_EXPANSION)
+		throw Fatal("HDAstar: anytime mode needs the default expansion");
+#endif
+		weights.clear();
+		for (double w = w0; w > 1.0 + 1e-9 && step > 0; w -= step)
+			weights.push_back(w);
+		weights.push_back(1.0);
+		weight = weights[0];
+	}
+
+	// set_checkpoint makes the search write a checkpoint to file every
+	// interval seconds (never if 0) and on request_checkpoint. file holds
+	// the header; the threads write file.<generation>.<thread id>, and
+	// the previous generation is removed once the next one is complete.
+	void set_checkpoint(const char* file, double interval) {
+#ifdef BATCH_EXPANSION
+		throw Fatal("HDAstar: checkpointing needs the default expansion");
+#endif
+		checkpoint_file = file;
+		checkpoint_interval = interval;
+	}
+
+	// request_checkpoint makes the search write a checkpoint as soon as
+	// it can (e.g. from a signal handler).
+	void request_checkpoint() {
+		checkpoint_requested = true;
+	}
+
+	// resume loads the checkpoint in file, to be carried on by the next
+	// call to search. It may have been written with another tnum.
+	void resume(const char* file) {
+		FILE* hdr = fopen(file, "rb");
+		if (!hdr)
+			throw Fatal("Failed to open %s", file);
+		char magic[8];
+		uint32_t gen, ckpt_tnum, bytes, npath;
+		int32_t inc;
+		uint64_t expd, gend, dup;
+		typename D::PackedState packed;
+		if (fread(magic, 1, 8, hdr) != 8 || memcmp(magic, "HDACKPT1", 8)
+				|| !read_field(hdr, gen) || !read_field(hdr, ckpt_tnum)
+				|| !read_field(hdr, bytes) || bytes != packed.byteSize()
+				|| !read_field(hdr, inc) || !read_field(hdr, expd)
+				|| !read_field(hdr, gend) || !read_field(hdr, dup)
+				|| !read_field(hdr, npath))
+			throw Fatal("%s: not a checkpoint of this domain", file);
+		std::vector<unsigned char> buf(bytes);
+		resumed_path.clear();
+		for (uint32_t i = 0; i < npath; ++i) {
+			if (fread(&buf[0], 1, bytes, hdr) != bytes)
+				throw Fatal("%s: truncated", file);
+			typename D::State s;
+			packed.charsToState(&buf[0]);
+			this->dom.unpack(s, packed);
+			resumed_path.push_back(s);
+		}
+		fclose(hdr);
+
+		resumed_nodes.reset(new Pool<Node>(2048));
+		resumed_closed.assign(tnum, std::vector<Node*>());
+		resumed_open.assign(tnum, std::vector<Node*>());
+		std::vector<Node*> by_index; // closed nodes by checkpoint index
+		std::vector<std::pair<Node*, uint32_t> > parents;
+		for (uint32_t t = 0; t < ckpt_tnum; ++t) {
+			std::string name = checkpoint_name(file, gen, t);
+			FILE* in = fopen(name.c_str(), "rb");
+			if (!in)
+				throw Fatal("Failed to open %s", name.c_str());
+			uint64_t nclosed, nopen;
+			if (!read_field(in, nclosed) || !read_field(in, nopen))
+				throw Fatal("%s: truncated", name.c_str());
+			std::vector<unsigned char> rec(bytes + RECORD_FIELDS * 4);
+			for (uint64_t i = 0; i < nclosed + nopen; ++i) {
+				if (fread(&rec[0], 1, rec.size(), in) != rec.size())
+					throw Fatal("%s: truncated", name.c_str());
+				uint32_t g, f, pop, parent, self;
+				memcpy(&g, &rec[bytes], 4);
+				memcpy(&f, &rec[bytes + 4], 4);
+				memcpy(&pop, &rec[bytes + 8], 4);
+				memcpy(&parent, &rec[bytes + 12], 4);
+				memcpy(&self, &rec[bytes + 16], 4);
+				Node* n;
+#ifdef PARTIAL_EXPANSION
+				// A closed node that was put back to open.
+				if (i >= nclosed && self != UINT32_MAX) {
+					n = by_index[self];
+					n->f = f;
+					resumed_open[n->zbr % tnum].push_back(n);
+					continue;
+				}
+#endif
+				n = resumed_nodes->construct();
+				n->g = g;
+				n->f = f;
+				n->pop = (int32_t) pop;
+				n->parent = 0;
+				n->packed.charsToState(&rec[0]);
+				typename D::State s;
+				this->dom.unpack(s, n->packed);
+				n->zbr = this->dom.dist_hash(s);
+#ifdef PACKED_EXPANSION
+				n->blank = s.blank;
+#endif
+#ifdef PARTIAL_EXPANSION
+				n->expanded = i < nclosed;
+#endif
+				if (parent != UINT32_MAX)
+					parents.push_back(std::make_pair(n, parent));
+				if (i < nclosed) {
+					by_index.push_back(n);
+					resumed_closed[n->zbr % tnum].push_back(n);
+				} else {
+					resumed_open[n->zbr % tnum].push_back(n);
+				}
+			}
+			fclose(in);
+		}
+		for (unsigned int i = 0; i < parents.size(); ++i) {
+			if (parents[i].second >= by_index.size())
+				throw Fatal("%s: broken parent link", file);
+			parents[i].first->parent = by_index[parents[i].second];
+		}
+
+		resumed = true;
+		resumed_incumbent = inc;
+		resumed_expd = expd;
+		resumed_gend = gend;
+		resumed_dup = dup;
+		checkpoint_gen = gen + 1;
+		dfpair(stdout, "resumed closed nodes", "%lu", by_index.size());
+	}
+
 //      32,334 length 46 : 14 1 9 6 4 8 12 5 7 2 3 0 10 11 13 15
 //     909,442 length 53 : 13 14 6 12 4 5 1 0 9 3 10 2 15 11 8 7
 //   5,253,685 length 57 : 5 12 10 7 15 11 14 0 8 2 1 13 3 4 9 6
@@ -226,13 +522,32 @@ public:
 		// 14414443
 		//129402307
 //		HashTable<typename D::PackedState, Node> closed(512927357 / tnum);
-		HashTable<typename D::PackedState, Node> closed(closedlistsize);
+		std::unique_ptr<HashTable<typename D::PackedState, Node> > own_closed;
+		std::unique_ptr<Pool<Node> > own_nodes;
+		if (arena) {
+			arena->closed[id]->clear();
+			arena->nodes[id]->reset();
+		} else {
+			own_closed.reset(
+					new HashTable<typename D::PackedState, Node>(closedlistsize));
+			own_nodes.reset(new Pool<Node>(2048));
+		}
+		HashTable<typename D::PackedState, Node> &closed =
+				arena ? *arena->closed[id] : *own_closed;
+		Pool<Node> &nodes = arena ? *arena->nodes[id] : *own_nodes;
 
 //	printf("closedlistsize = %u\n", closedlistsize);
 
 //		Heap<Node> open(100, overrun);
 		heap open(openlistsize, overrun, isFIFO);
-		Pool<Node> nodes(2048);
+
+		// Added oldest first, so that find returns the newest copy.
+		if (resumed) {
+			for (int i = resumed_closed[id].size() - 1; i >= 0; --i)
+				closed.add(resumed_closed[id][i]);
+			for (unsigned int i = 0; i < resumed_open[id].size(); ++i)
+				open.push(resumed_open[id][i]);
+		}
 
 		// If the buffer is locked when the thread pushes a node,
 		// stores it locally and pushes it afterward.
@@ -241,9 +556,15 @@ public:
 		// Therefore, not the best optimized way to do.
 		// Also we need to fix it to compile in clang++.
 		std::vector<std::vector<Node*>> outgo_buffer;
-		outgo_buffer.reserve(tnum);
+		outgo_buffer.resize(tnum);
 
 		std::vector<Node*> tmp;
+
+#ifdef BATCH_EXPANSION
+		// Nodes closed but not expanded yet. They are expanded together
+		// once BATCH_EXPANSION nodes are collected or the open list runs dry.
+		Batch batch;
+#endif
 //		tmp.reserve(10); // TODO: ad hoc random number
 
 		uint expd_here = 0;
@@ -270,18 +591,63 @@ public:
 
 		unsigned int over_incumbent_count = 0;
 		unsigned int no_work_iteration = 0;
+#ifdef PARTIAL_EXPANSION
+		unsigned long reinserted_here = 0;
+#endif
 
 		double init_time = walltime();
+		unsigned int checkpoint_tick = 0;
 
 		while (true) {
 			Node *n;
 
+			if (run_state == CHECKPOINT) {
+				expd_distribution[id] = expd_here;
+				gend_distribution[id] = gend_here;
+				duplicates[id] = duplicate_here;
+				write_checkpoint(id, open, closed, outgo_buffer);
+				continue;
+			}
+			if (id == 0 && !checkpoint_file.empty()
+					&& (++checkpoint_tick & 255) == 0
+					&& (checkpoint_requested
+							|| (checkpoint_interval > 0
+									&& walltime() - last_checkpoint
+											> checkpoint_interval))) {
+				checkpoint_requested = false;
+				int s = RUN;
+				run_state.compare_exchange_strong(s, CHECKPOINT);
+				continue;
+			}
+
+			if (freeze && may_stop()) {
+				freeze_open(id, open, outgo_buffer);
+				break;
+			}
+
 			if (this->isTimed) {
 				double t = walltime() - init_time;
 //				printf("t = %f\n", t);
-				if (t > this->timer) {
+				if (t > this->timer && may_stop()) {
 //					closed.destruct_all(nodes);
 					printf("Terminated due to timer\n");
+					if (weights.size() > 1) {
+						stop_anytime = true;
+						next_pass(id, open, nodes);
+					}
+					break;
+				}
+			}
+
+			if (this->shared) {
+				int c = this->shared->cost, i = incumbent;
+				while (c < i && !incumbent.compare_exchange_weak(i, c))
+					;
+				if (this->shared->stop && may_stop()) {
+					if (weights.size() > 1) {
+						stop_anytime = true;
+						next_pass(id, open, nodes);
+					}
 					break;
 				}
 			}
@@ -295,6 +661,7 @@ public:
 					++force_income;
 					income_buffer[id].lock();
 					tmp = income_buffer[id].pull_all_with_lock();
+					received_nodes += tmp.size();
 					income_buffer[id].release_lock();
 					uint size = tmp.size();
 #ifdef ANALYZE_INCOME
@@ -310,6 +677,7 @@ public:
 					tmp.clear();
 				} else if (income_buffer[id].try_lock()) {
 					tmp = income_buffer[id].pull_all_with_lock();
+					received_nodes += tmp.size();
 //					printf("%d", __LINE__);
 					income_buffer[id].release_lock();
 
@@ -335,27 +703,45 @@ public:
 			open_sizes[id] = open.getsize();
 #endif
 			if (open.isemptyunder(incumbent.load())) {
-				dbgprintf("open is empty.\n");
-				terminate[id] = true;
-				if (hasterminated() && incumbent != initmaxcost) {
-					printf("terminated\n");
-					break;
+#ifdef BATCH_EXPANSION
+				if (!batch.nodes.empty()) {
+					gend_here += expand_batch(batch, id, open, nodes,
+							outgo_buffer, self_push);
+					continue;
 				}
+#endif
+				dbgprintf("open is empty.\n");
 				++no_work_iteration;
 
+				// A thread is idle only once its outgo buffers are delivered.
+				// Otherwise every thread may terminate while nodes are left
+				// in the buffers.
+				bool delivered = true;
 				for (int i = 0; i < tnum; ++i) {
 					// TODO: least number of nodes to send
 					if (i != id && outgo_buffer[i].size() > 0) {
 						if (income_buffer[i].try_lock()) {
 							// acquired lock
+							sent_nodes += outgo_buffer[i].size();
 							income_buffer[i].push_all_with_lock(
 									outgo_buffer[i]);
 							income_buffer[i].release_lock();
 							outgo_buffer[i].clear();
+						} else {
+							delivered = false;
 						}
 					}
 				}
 
+				terminate[id] = delivered;
+				if (delivered && hasterminated() && incumbent != initmaxcost
+						&& !freeze && may_stop()) {
+					if (weights.size() > 1 && next_pass(id, open, nodes)) {
+						continue;
+					}
+					printf("terminated\n");
+					break;
+				}
 
 				continue; // ad hoc
 			}
@@ -397,9 +783,20 @@ public:
 			startlapse(&lapse); // closed list
 #endif
 //		if (n->thrown == 0) {
+			// Compared by g, as f of a closed node is of the weight it was
+			// expanded with in anytime mode.
 			Node *duplicate = closed.find(n->packed);
+#ifdef PARTIAL_EXPANSION
+			// A node put back is closed already. It is dropped (but kept
+			// as a parent) once the state is closed with a smaller g.
+			if (n->expanded) {
+				if (duplicate != n)
+					continue;
+				duplicate = 0;
+			}
+#endif
 			if (duplicate) {
-				if (duplicate->f <= n->f) {
+				if (duplicate->g <= n->g) {
 					dbgprintf("Discarded\n");
 					nodes.destruct(n);
 					continue;
@@ -431,22 +828,30 @@ public:
 				continue;
 			}
 #endif // OUTSOURCING
-			typename D::State state;
-			this->dom.unpack(state, n->packed);
-
 #ifdef ANALYZE_ORDER
 			if (fval != n->f) {
 				fval = n->f;
 				LogNodeOrder* ln = new LogNodeOrder(globalOrder.fetch_add(1),
-						state.tiles, fval, open.getsize());
+						n->packed, fval, open.getsize());
 				lognodeorder[id].push_back(*ln);
 			} else {
 				LogNodeOrder* ln = new LogNodeOrder(globalOrder.fetch_add(1),
-						state.tiles, -1, open.getsize());
+						n->packed, -1, open.getsize());
 				lognodeorder[id].push_back(*ln);
 			}
 #endif // ANALYZE_ORDER
+#ifdef PACKED_EXPANSION
+			if (this->dom.isgoal_packed(n->packed)) {
+#else
+			typename D::State state;
+			this->dom.unpack(state, n->packed);
+			if (weights.size() > 1
+					&& n->g + this->dom.h(state) >= (unsigned int) incumbent) {
+				nodes.destruct(n);
+				continue;
+			}
 			if (this->dom.isgoal(state)) {
+#endif // PACKED_EXPANSION
 				// TODO: For some reason, sometimes pops broken node.
 //				if (state.tiles[1] == 0) {
 //					printf("isgoal ERROR\n");
@@ -469,10 +874,12 @@ public:
 					// TODO: this should be changed to match non-unit cost domains.
 					incumbent = n->g;
 					LogIncumbent* li = new LogIncumbent(walltime() - wall0,
-							incumbent);
+							incumbent, anytime_bound);
 					logincumbent[id].push_back(*li);
 					path = newpath;
 				}
+				if (this->shared)
+					this->shared->offer(n->g, newpath);
 
 				continue;
 			}
@@ -480,10 +887,21 @@ public:
 			if (n->thrown == 0) {
 				closed.add(n);
 			}
+#elif defined(PARTIAL_EXPANSION)
+			if (!n->expanded) {
+				closed.add(n);
+				n->expanded = true;
+				expd_here++;
+			}
 #else
 			closed.add(n);
 #endif
+#ifndef PARTIAL_EXPANSION
 			expd_here++;
+#endif
+			if (memory_budget && nodes.bytes() > memory_budget / tnum) {
+				freeze = true;
+			}
 			//		printf("expd: %d\n", id);
 
 #ifdef ANALYZE_LAPSE
@@ -492,6 +910,26 @@ public:
 
 //			buffer<Node>* buffers;
 
+#ifdef PACKED_EXPANSION
+			gend_here += expand_packed(n, id, open, nodes, outgo_buffer,
+					self_push);
+#else
+
+#ifdef BATCH_EXPANSION
+			batch.nodes.push_back(n);
+			batch.states.push_back(state);
+			if (batch.nodes.size() >= BATCH_EXPANSION) {
+				gend_here += expand_batch(batch, id, open, nodes, outgo_buffer,
+						self_push);
+			}
+			continue;
+#endif
+
+#ifdef PARTIAL_EXPANSION
+			int fn = n->g + this->dom.h(state);
+			int want = n->f - fn;
+			int next_df = -1;
+#endif
 			// TODO: this is only applicable for STRIPS planning.
 			std::vector<unsigned int> ops = this->dom.ops(state);
 			for (int i = 0; i < ops.size(); i++) {
@@ -503,6 +941,14 @@ public:
 					//					printf("erase %d \n", i);
 					continue;
 				}
+#ifdef PARTIAL_EXPANSION
+				int df = this->dom.delta_f(state, op);
+				if (df != want) {
+					if (df > want && (next_df < 0 || df < next_df))
+						next_df = df;
+					continue;
+				}
+#endif
 
 //				printf("gend: %d\n", id);
 
@@ -513,6 +959,12 @@ public:
 //				int moving_tile = state.tiles[op];
 //				int blank = state.blank; // Make this available for Grid pathfinding.
 				Edge<D> e = this->dom.apply(state, op);
+				if (weights.size() > 1
+						&& n->g + e.cost + this->dom.h(state)
+								>= (unsigned int) incumbent) {
+					this->dom.undo(state, e);
+					continue;
+				}
 				Node* next = wrap(state, n, e.cost, e.pop, nodes);
 
 				///////////////////////////
@@ -567,6 +1019,7 @@ public:
 				// Synchronous communication to avoid search overhead
 				else if (outgo_buffer[zbr].size() > outgo_threshold) {
 					income_buffer[zbr].lock();
+					sent_nodes += outgo_buffer[zbr].size() + 1;
 					income_buffer[zbr].push_with_lock(next);
 					income_buffer[zbr].push_all_with_lock(outgo_buffer[zbr]);
 //					printf("%d", __LINE__);
@@ -610,6 +1063,7 @@ public:
 					if (i != id && outgo_buffer[i].size() > 31) {
 						if (income_buffer[i].try_lock()) {
 							// acquired lock
+							sent_nodes += outgo_buffer[i].size();
 							income_buffer[i].push_all_with_lock(
 									outgo_buffer[i]);
 							income_buffer[i].release_lock();
@@ -621,6 +1075,14 @@ public:
 
 				this->dom.undo(state, e);
 			}
+#ifdef PARTIAL_EXPANSION
+			if (next_df >= 0) {
+				n->f = fn + next_df;
+				open.push(n);
+				++reinserted_here;
+			}
+#endif
+#endif // PACKED_EXPANSION
 #ifdef ANALYZE_LAPSE
 			endlapse(lapse, "expand");
 #endif
@@ -655,6 +1117,9 @@ public:
 
 		this->duplicates[id] = duplicate_here;
 		this->self_pushes[id] = self_push;
+#ifdef PARTIAL_EXPANSION
+		reinserted += reinserted_here;
+#endif
 		this-
 
 		dbgprintf("END\n");
@@ -664,23 +1129,292 @@ public:
 		return 0;
 	}
 
+	// freeze_open delivers the outgo buffers, waits for the other threads
+	// and moves the nodes of the income buffer and the open list to
+	// frozen[id].
+	template<class heap>
+	void freeze_open(int id, heap &open,
+			std::vector<std::vector<Node*>> &outgo_buffer) {
+		for (int i = 0; i < tnum; ++i) {
+			if (i != id && outgo_buffer[i].size() > 0) {
+				income_buffer[i].lock();
+				sent_nodes += outgo_buffer[i].size();
+				income_buffer[i].push_all_with_lock(outgo_buffer[i]);
+				income_buffer[i].release_lock();
+				outgo_buffer[i].clear();
+			}
+		}
+		pthread_barrier_wait(&barrier);
+		income_buffer[id].lock();
+		frozen[id] = income_buffer[id].pull_all_with_lock();
+		received_nodes += frozen[id].size();
+		income_buffer[id].release_lock();
+		while (!open.isempty()) {
+			frozen[id].push_back(open.pop());
+		}
+	}
+
+	// may_stop returns false if a checkpoint is under way, and otherwise
+	// keeps any from being begun.
+	bool may_stop() {
+		int s = RUN;
+		return run_state.compare_exchange_strong(s, DONE) || s == DONE;
+	}
+
+	// write_checkpoint is called by every thread once thread 0 has begun
+	// a checkpoint. The outgo buffers are delivered and the income
+	// buffers taken into the open lists, so the open and closed lists
+	// and the incumbent are the whole state of the search. Closed nodes
+	// are numbered in zbr (which is not used once a node is closed) so
+	// that parents are written as indices.
+	template<class heap>
+	void write_checkpoint(int id, heap &open,
+			HashTable<typename D::PackedState, Node> &closed,
+			std::vector<std::vector<Node*>> &outgo_buffer) {
+		for (int i = 0; i < tnum; ++i) {
+			if (i != id && outgo_buffer[i].size() > 0) {
+				income_buffer[i].lock();
+				sent_nodes += outgo_buffer[i].size();
+				income_buffer[i].push_all_with_lock(outgo_buffer[i]);
+				income_buffer[i].release_lock();
+				outgo_buffer[i].clear();
+			}
+		}
+		pthread_barrier_wait(&barrier);
+		income_buffer[id].lock();
+		std::vector<Node*> tmp = income_buffer[id].pull_all_with_lock();
+		received_nodes += tmp.size();
+		income_buffer[id].release_lock();
+		for (unsigned int i = 0; i < tmp.size(); ++i)
+			open.push(tmp[i]);
+
+		unsigned long count = 0;
+		closed.for_each([&](Node *c) {++count;});
+		checkpoint_count[id] = count;
+		pthread_barrier_wait(&barrier);
+
+		unsigned long index = 0, total = 0;
+		for (int i = 0; i < tnum; ++i) {
+			if (i < id)
+				index += checkpoint_count[i];
+			total += checkpoint_count[i];
+		}
+		if (total >= UINT32_MAX)
+			throw Fatal("HDAstar: too many closed nodes to checkpoint");
+		closed.for_each([&](Node *c) {c->zbr = index++;});
+		pthread_barrier_wait(&barrier);
+
+		std::string name = checkpoint_name(checkpoint_file, checkpoint_gen,
+				id);
+		FILE* out = fopen(name.c_str(), "wb");
+		if (!out)
+			throw Fatal("Failed to open %s", name.c_str());
+		std::vector<Node*> rest;
+		while (!open.isempty())
+			rest.push_back(static_cast<Node*>(open.pop()));
+		uint64_t nclosed = count, nopen = rest.size();
+		write_field(out, nclosed);
+		write_field(out, nopen);
+		std::vector<unsigned char> buf;
+		closed.for_each([&](Node *c) {write_node(out, c, UINT32_MAX, buf);});
+		for (unsigned int i = 0; i < rest.size(); ++i) {
+			uint32_t self = UINT32_MAX;
+#ifdef PARTIAL_EXPANSION
+			if (rest[i]->expanded)
+				self = rest[i]->zbr;
+#endif
+			write_node(out, rest[i], self, buf);
+			open.push(rest[i]);
+		}
+		fwrite(buf.data(), 1, buf.size(), out);
+		if (fclose(out) != 0)
+			throw Fatal("Failed to write %s", name.c_str());
+		pthread_barrier_wait(&barrier);
+
+		if (id == 0) {
+			write_checkpoint_header();
+			if (checkpoint_gen > 0) {
+				for (int i = 0;; ++i) {
+					if (remove(
+							checkpoint_name(checkpoint_file, checkpoint_gen - 1,
+									i).c_str()))
+						break;
+				}
+			}
+			dfrow(stdout, "checkpoint", "uug", (unsigned long) checkpoint_gen,
+					total, walltime() - wall0);
+			++checkpoint_gen;
+			last_checkpoint = walltime();
+			run_state = RUN;
+		}
+		pthread_barrier_wait(&barrier);
+	}
+
+	// write_checkpoint_header writes the header of the checkpoint in
+	// checkpoint_gen by renaming, so that a crash leaves the previous one.
+	void write_checkpoint_header() {
+		std::string tmp = checkpoint_file + ".tmp";
+		FILE* out = fopen(tmp.c_str(), "wb");
+		if (!out)
+			throw Fatal("Failed to open %s", tmp.c_str());
+		uint64_t expd = resumed_expd, gend = resumed_gend, dup = resumed_dup;
+		for (int i = 0; i < tnum; ++i) {
+			expd += expd_distribution[i];
+			gend += gend_distribution[i];
+			dup += duplicates[i];
+		}
+		typename D::PackedState packed;
+		uint32_t gen = checkpoint_gen, t = tnum, bytes = packed.byteSize(),
+				npath = path.size();
+		int32_t inc = incumbent;
+		fwrite("HDACKPT1", 1, 8, out);
+		write_field(out, gen);
+		write_field(out, t);
+		write_field(out, bytes);
+		write_field(out, inc);
+		write_field(out, expd);
+		write_field(out, gend);
+		write_field(out, dup);
+		write_field(out, npath);
+		std::vector<unsigned char> buf(bytes);
+		for (uint32_t i = 0; i < npath; ++i) {
+			this->dom.pack(packed, path[i]);
+			packed.stateToChars(&buf[0]);
+			fwrite(&buf[0], 1, bytes, out);
+		}
+		if (fclose(out) != 0 || rename(tmp.c_str(), checkpoint_file.c_str()))
+			throw Fatal("Failed to write %s", checkpoint_file.c_str());
+	}
+
+	// A node is written as its packed state followed by g, f, pop, the
+	// index of its parent and self, its own index if it is also closed
+	// (all 32 bits).
+	static const unsigned int RECORD_FIELDS = 5;
+
+	// write_node appends the record of n to buf, which is written to out
+	// once it holds a megabyte.
+	void write_node(FILE* out, Node *n, uint32_t self,
+			std::vector<unsigned char> &buf) {
+		unsigned int bytes = n->packed.byteSize();
+		uint32_t rec[RECORD_FIELDS] = { n->g, n->f, (uint32_t) (int32_t) n->pop,
+				n->parent ? n->parent->zbr : UINT32_MAX, self };
+		unsigned int at = buf.size();
+		buf.resize(at + bytes + sizeof(rec));
+		n->packed.stateToChars(&buf[at]);
+		memcpy(&buf[at + bytes], rec, sizeof(rec));
+		if (buf.size() >= (1 << 20)) {
+			fwrite(buf.data(), 1, buf.size(), out);
+			buf.clear();
+		}
+	}
+
+	template<class T>
+	static void write_field(FILE* out, const T &v) {
+		fwrite(&v, sizeof(T), 1, out);
+	}
+
+	template<class T>
+	static bool read_field(FILE* in, T &v) {
+		return fread(&v, sizeof(T), 1, in) == 1;
+	}
+
+	static std::string checkpoint_name(const std::string &file,
+			unsigned int gen, int id) {
+		return file + "." + std::to_string(gen) + "."
+				+ std::to_string(id);
+	}
+
+	// next_pass is called by every thread once a pass of the anytime
+	// search is over (or on the timer). Thread 0 moves to the next weight,
+	// every thread rekeys its open list with it, and thread 0 logs the
+	// incumbent with the smallest g + h left open as the lower bound.
+	// Returns false once the incumbent is proven optimal or on the timer.
+	template<class heap>
+	bool next_pass(int id, heap &open, Pool<Node> &nodes) {
+		pthread_barrier_wait(&barrier);
+		if (id == 0) {
+			++pass;
+			anytime_done = stop_anytime || pass >= weights.size();
+			if (!anytime_done)
+				weight = weights[pass];
+			anytime_bound = incumbent.load();
+		}
+		pthread_barrier_wait(&barrier);
+
+		std::vector<Node*> rest;
+		while (!open.isempty())
+			rest.push_back(open.pop());
+		int lb = incumbent;
+		for (unsigned int i = 0; i < rest.size(); ++i) {
+			Node *n = rest[i];
+			typename D::State state;
+			this->dom.unpack(state, n->packed);
+			int h = this->dom.h(state);
+			if (n->g + h < lb)
+				lb = n->g + h;
+			if (anytime_done || n->g + h >= (unsigned int) incumbent) {
+				nodes.destruct(n);
+				continue;
+			}
+			n->f = n->g + h * weight;
+			open.push(n);
+		}
+		int b = anytime_bound;
+		while (lb < b && !anytime_bound.compare_exchange_weak(b, lb))
+			;
+		terminate[id] = false;
+		pthread_barrier_wait(&barrier);
+
+		if (id == 0) {
+			LogIncumbent li(walltime() - wall0, incumbent, anytime_bound);
+			logincumbent[0].push_back(li);
+			if (anytime_bound >= incumbent)
+				anytime_done = true;
+		}
+		pthread_barrier_wait(&barrier);
+		return !anytime_done;
+	}
+
 	std::vector<typename D::State> search(typename D::State &init) {
 		printf("search\n");
 		pthread_t t[tnum];
 		this->init = init;
+		if (!checkpoint_file.empty() && weights.size() > 1)
+			throw Fatal("HDAstar: checkpointing is not for anytime mode");
 
 		// wrap a new node.
 		Node* n = new Node;
 		{
 			n->g = 0;
-			n->f = this->dom.h(init);
+			n->f = this->dom.h(init) * weight;
 			n->pop = -1;
 			n->parent = 0;
 			this->dom.pack(n->packed, init);
+			n->zbr = this->dom.dist_hash(init);
+#ifdef PACKED_EXPANSION
+			n->blank = init.blank;
+#endif
+#ifdef PARTIAL_EXPANSION
+			n->expanded = false;
+#endif
 		}
 //		dbgprintf("zobrist of init = %d", z.hash_tnum(init.tiles));
 
-		income_buffer[0].push(n);
+		sent_nodes = 1;
+		received_nodes = 0;
+#ifdef PARTIAL_EXPANSION
+		reinserted = 0;
+#endif
+		if (resumed) {
+			// The open and closed lists of the checkpoint are taken by
+			// the threads when they start.
+			delete n;
+			sent_nodes = 0;
+			incumbent = resumed_incumbent;
+			path = resumed_path;
+		} else {
+			income_buffer[0].push(n);
+		}
 //		income_buffer[z.hash_tnum(init.tiles)].push(n);
 
 		wall0 = walltime();
@@ -691,14 +1425,26 @@ public:
 #endif
 
 		pthread_barrier_init(&barrier, NULL, tnum);
+		freeze = false;
+		frozen.assign(tnum, std::vector<Node*>());
+		pass = 0;
+		anytime_done = false;
+		stop_anytime = false;
+		anytime_bound = this->dom.h(init);
+		run_state = RUN;
+		last_checkpoint = walltime();
 
 		printf("start\n");
-		for (int i = 0; i < tnum; ++i) {
-			pthread_create(&t[i], NULL,
-					(void*(*)(void*))&HDAstar::thread_helper, this);
-		}
-		for (int i = 0; i < tnum; ++i) {
-			pthread_join(t[i], NULL);
+		if (pool) {
+			pool->run(tnum, &HDAstar::thread_helper, this);
+		} else {
+			for (int i = 0; i < tnum; ++i) {
+				pthread_create(&t[i], NULL,
+						(void*(*)(void*))&HDAstar::thread_helper, this);
+			}
+			for (int i = 0; i < tnum; ++i) {
+				pthread_join(t[i], NULL);
+			}
 		}
 
 		for (int i = 0; i < tnum; ++i) {
@@ -707,7 +1453,12 @@ public:
 			this->lpush += self_pushes[i];
 			this->dup += duplicates[i];
 		}
-
+		if (resumed) {
+			this->expd += resumed_expd;
+			this->gend += resumed_gend;
+			this->dup += resumed_dup;
+			resumed = false;
+		}
 
 #ifdef ANALYZE_INCOME
 		printf("average of max_income_buffer_size = %d\n", max_income / tnum);
@@ -741,6 +1492,10 @@ public:
 		}
 		printf("\n");
 #endif
+#ifdef PARTIAL_EXPANSION
+		printf("reinserted = %lu\n", reinserted.load());
+#endif
+		printf("sent nodes = %lu\n", sent_nodes.load());
 		printf("forcepush incomebuffer = %d\n", force_income);
 		printf("forcepush outgobuffer = %d\n", force_outgo);
 
@@ -753,21 +1508,25 @@ public:
 		}
 
 #endif
-#ifdef ANALYZE_INCUMBENT_TRACE
+#ifndef ANALYZE_INCUMBENT_TRACE
+		if (weights.size() > 1)
+#endif
 		for (int i = 0; i < tnum; ++i) {
 			for (int j = 0; j < this->logincumbent[i].size(); ++j) {
-				printf("incumbent %f %d %d\n", logincumbent[i][j].walltime,
-						i, logincumbent[i][j].incumbent);
+				printf("incumbent %f %d %d %d\n", logincumbent[i][j].walltime,
+						i, logincumbent[i][j].incumbent,
+						logincumbent[i][j].bound);
 			}
 		}
 
-#endif
 
 #ifdef ANALYZE_ORDER
 		for (int id = 0; id < tnum; ++id) {
 			for (int i = 0; i < lognodeorder[id].size(); ++i) {
-				printf("%d %d %016lx %d %d\n", id, lognodeorder[id][i].globalOrder, lognodeorder[id][i].packedState,
-						lognodeorder[id][i].fvalue, lognodeorder[id][i].openlistSize);
+				printf("%d %d ", id, lognodeorder[id][i].globalOrder);
+				lognodeorder[id][i].print(stdout);
+				printf(" %d %d\n", lognodeorder[id][i].fvalue,
+						lognodeorder[id][i].openlistSize);
 			}
 		}
 #endif // ANALYZE_ORDER
@@ -798,27 +1557,143 @@ public:
 //		return static_cast<HDAstar*>(arg)->thread_search<NaiveHeap<Node> >(arg);
 	}
 
+#ifdef BATCH_EXPANSION
+	// expand_batch expands every node in the batch. All children are
+	// generated first without their heuristic values, which are then
+	// computed together by the domain (see Tiles24::heuristic_batch)
+	// so that the table lookups of different children overlap.
+	// Returns the number of nodes generated.
+	template<class heap>
+	unsigned int expand_batch(Batch &batch, int id, heap &open,
+			Pool<Node> &nodes, std::vector<std::vector<Node*>> &outgo_buffer,
+			unsigned int &self_push) {
+		for (unsigned int i = 0; i < batch.nodes.size(); ++i) {
+			Node *n = batch.nodes[i];
+			typename D::State &state = batch.states[i];
+			int nops = this->dom.nops(state);
+			for (int j = 0; j < nops; ++j) {
+				int op = this->dom.nthop(state, j);
+				if (op == n->pop) {
+					continue;
+				}
+				batch.kids.push_back(state);
+				batch.edges.push_back(
+						this->dom.apply_lazy(batch.kids.back(), op));
+				batch.parents.push_back(n);
+			}
+		}
+
+		this->dom.heuristic_batch(batch.kids.data(), batch.kids.size());
+
+		unsigned int gend = batch.kids.size();
+		for (unsigned int i = 0; i < gend; ++i) {
+			Node* next = wrap(batch.kids[i], batch.parents[i],
+					batch.edges[i].cost, batch.edges[i].pop, nodes);
+			next->zbr = this->dom.dist_hash(batch.kids[i]);
+			dispatch(next, id, open, outgo_buffer, self_push);
+		}
+		flush_outgo(id, outgo_buffer);
+
+		batch.nodes.clear();
+		batch.states.clear();
+		batch.kids.clear();
+		batch.edges.clear();
+		batch.parents.clear();
+		return gend;
+	}
+#endif // BATCH_EXPANSION
+
+#ifdef PACKED_EXPANSION
+	// expand_packed generates the children of n from n->packed alone.
+	// Returns the number of nodes generated.
+	template<class heap>
+	unsigned int expand_packed(Node *n, int id, heap &open, Pool<Node> &nodes,
+			std::vector<std::vector<Node*>> &outgo_buffer,
+			unsigned int &self_push) {
+		unsigned int gend = 0;
+		int nops = this->dom.nops_packed(n->blank);
+		for (int i = 0; i < nops; ++i) {
+			int op = this->dom.nthop_packed(n->blank, i);
+			if (op == n->pop) {
+				continue;
+			}
+			int h = n->f - n->g;
+			Node *next = nodes.construct();
+			next->zbr = n->zbr;
+			next->packed = this->dom.apply_packed(n->packed, n->blank, op, h,
+					next->zbr);
+			next->g = n->g + 1;
+			next->f = next->g + h;
+			next->pop = n->blank;
+			next->blank = op;
+			next->parent = n;
+			dispatch(next, id, open, outgo_buffer, self_push);
+			++gend;
+		}
+		flush_outgo(id, outgo_buffer);
+		return gend;
+	}
+#endif // PACKED_EXPANSION
+
+#if defined(BATCH_EXPANSION) || defined(PACKED_EXPANSION)
+	// dispatch pushes next to the open list of its owner thread.
+	template<class heap>
+	inline void dispatch(Node *next, int id, heap &open,
+			std::vector<std::vector<Node*>> &outgo_buffer,
+			unsigned int &self_push) {
+		unsigned int zbr = next->zbr % tnum;
+		if (zbr == id) {
+			++self_push;
+			open.push(next);
+		} else {
+			outgo_buffer[zbr].push_back(next);
+		}
+	}
+
+	inline void flush_outgo(int id,
+			std::vector<std::vector<Node*>> &outgo_buffer) {
+		for (int i = 0; i < tnum; ++i) {
+			if (i != id && outgo_buffer[i].size() > 0) {
+				if (income_buffer[i].try_lock()) {
+					sent_nodes += outgo_buffer[i].size();
+					income_buffer[i].push_all_with_lock(outgo_buffer[i]);
+					income_buffer[i].release_lock();
+					outgo_buffer[i].clear();
+				}
+			}
+		}
+	}
+#endif
+
 	inline Node *wrap(typename D::State &s, Node *p, int c, int pop,
 			Pool<Node> &nodes) {
 		Node *n = nodes.construct();
 		n->g = c;
 		if (p)
 			n->g += p->g;
-		n->f = n->g + this->dom.h(s);
+		n->f = n->g + this->dom.h(s) * weight;
 //		printf("h = %d\n", this->dom.weight_h(s));
 		n->pop = pop;
 		n->parent = p;
+#ifdef PARTIAL_EXPANSION
+		n->expanded = false;
+#endif
 		this->dom.pack(n->packed, s);
 		return n;
 	}
 
+	// Every thread is idle and no node is left in the income buffers.
+	// received_nodes is read before the flags and sent_nodes after them,
+	// so a node sent to an idle thread after its flag was read keeps
+	// the two counts apart.
 	inline bool hasterminated() {
+		unsigned long received = received_nodes.load();
 		for (int i = 0; i < tnum; ++i) {
 			if (terminate[i] == false) {
 				return false;
 			}
 		}
-		return true;
+		return sent_nodes.load() == received;
 	}
 
 //	template<class H>
@@ -107,31 +107,21 @@ template<class D, class hash> class HDAstarSharedClosed: public SearchAlg<D> {
 
 	struct LogNodeOrder {
 		int globalOrder;
-		uint64_t packedState;
+		typename D::PackedState packedState;
 		int fvalue;
 		int openlistSize;
-		LogNodeOrder(int globalOrder_, char* tiles, int fvalue_ = -1,
-				int openlistSize_ = -1) :
-				globalOrder(globalOrder_), fvalue(fvalue_), openlistSize(
+		LogNodeOrder(int globalOrder_, const typename D::PackedState& packed,
+				int fvalue_ = -1, int openlistSize_ = -1) :
+				globalOrder(globalOrder_), packedState(packed), fvalue(fvalue_), openlistSize(
 						openlistSize_) {
-			packedState = pack(tiles);
 		}
-		uint64_t pack(char* tiles) {
-			uint64_t word = 0; // to make g++ shut up about uninitialized usage.
-			for (int i = 0; i < D::Ntiles; i++) {
-				word = (word << 4) | tiles[i];
+		// print prints the packed state as hex, most significant byte first.
+		void print(FILE* out) const {
+			std::vector<unsigned char> bytes(packedState.byteSize());
+			packedState.stateToChars(&bytes[0]);
+			for (unsigned int i = 0; i < packedState.byteSize(); ++i) {
+				fprintf(out, "%02x", bytes[i]);
 			}
-			return word;
-		}
-		char* unpack() {
-			uint64_t word = packedState;
-			char* tiles = new char[D::Ntiles];
-			for (int i = D::Ntiles - 1; i >= 0; i--) {
-				int t = word & 0xF; // 15 Puzzle specific
-				word >>= 4;
-				tiles[i] = t;
-			}
-			return tiles;
 		}
 	};
 	std::vector<LogNodeOrder>* lognodeorder;
@@ -392,11 +382,11 @@ public:
 			if (fval != n->f) {
 				fval = n->f;
 				LogNodeOrder* ln = new LogNodeOrder(globalOrder.fetch_add(1),
-						state.tiles, fval, open.getsize());
+						n->packed, fval, open.getsize());
 				lognodeorder[id].push_back(*ln);
 			} else {
 				LogNodeOrder* ln = new LogNodeOrder(globalOrder.fetch_add(1),
-						state.tiles, -1, open.getsize());
+						n->packed, -1, open.getsize());
 				lognodeorder[id].push_back(*ln);
 			}
 #endif // ANALYZE_ORDER
@@ -649,8 +639,10 @@ public:
 #ifdef ANALYZE_ORDER
 		for (int id = 0; id < tnum; ++id) {
 			for (int i = 0; i < lognodeorder[id].size(); ++i) {
-				printf("%d %d %016lx %d %d\n", id, lognodeorder[id][i].globalOrder, lognodeorder[id][i].packedState,
-						lognodeorder[id][i].fvalue, lognodeorder[id][i].openlistSize);
+				printf("%d %d ", id, lognodeorder[id][i].globalOrder);
+				lognodeorder[id][i].print(stdout);
+				printf(" %d %d\n", lognodeorder[id][i].fvalue,
+						lognodeorder[id][i].openlistSize);
 			}
 		}
 #endif // ANALYZE_ORDER
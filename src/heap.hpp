@@ -11,6 +11,7 @@
 #endif // #ifdef DEBUG
 
 #include "fatal.hpp"
+#include <cstdio>
 #include <vector>
 #include <limits>
 #include <cassert>
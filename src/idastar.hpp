@@ -1,12 +1,17 @@
 // Copyright 2012 Ethan Burns. All rights reserved.
 // Use of this source code is governed by an MIT-style
 // license that can be found in the LICENSE file.
+#ifndef _IDASTAR_HPP_
+#define _IDASTAR_HPP_
+
 #include "search.hpp"
 #include "utils.hpp"
+#include "shared_incumbent.hpp"
 
 template<class D> class Idastar : public SearchAlg<D> {
 	std::vector<typename D::State> path;
 	int bound, minoob;
+	int cost; // of path
 
 public:
 
@@ -25,18 +30,32 @@ public:
 			dfrow(stdout, "iteration", "uduu", (unsigned long) n, (long) bound,
 				this->expd, this->gend);
 			bound = minoob;
-		} while (path.size() == 0);
+		} while (path.size() == 0 && !proven());
 
+		if (this->shared && path.size() > 0)
+			this->shared->offer(cost, path);
 		return path;
 	}
 
 private:
 
+	// proven returns true if the shared incumbent is optimal or stop is
+	// set: no node under the incumbent is left.
+	bool proven() {
+		if (!this->shared)
+			return false;
+		return this->shared->stop || bound < 0 || bound >= this->shared->cost;
+	}
+
 	bool dfs(typename D::State &n,  int cost, int pop) {
 		int f = cost + this->dom.h(n);
 
+		if (this->shared && (f >= this->shared->cost || this->shared->stop))
+			return false;
+
 		if (f <= bound && this->dom.isgoal(n)) {
 			path.push_back(n);
+			this->cost = cost;
 			return true;
 		}
 
@@ -65,4 +84,6 @@ private:
 
 		return false;
 	}
-};
\ No newline at end of file
+};
+
+#endif // _IDASTAR_HPP_
@@ -0,0 +1,211 @@
+/*
+ * idastar_tt.hpp
+ *
+ * IDA* with a fixed-size transposition table. The table keeps, for
+ * each state it holds, the smallest g it was reached with and a
+ * backed-up h, a lower bound of the cost to go. The search of a subtree
+ * skips the move back to the parent, so the smallest f - g found under
+ * the state only bounds the paths that do not go back; the backed-up h
+ * is the smaller of it and the cost back plus the h of the parent.
+ *
+ * A node is pruned if the table has reached it with a smaller g, or
+ * with the same g in this iteration (the subtree was searched with the
+ * same budget). Otherwise the backed-up h replaces h when it is larger.
+ * The table size trades memory for time between plain IDA* (size 0)
+ * and A*.
+ */
+
+#ifndef IDASTAR_TT_HPP_
+#define IDASTAR_TT_HPP_
+
+#include "search.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <stdint.h>
+
+// TranspositionTable is a table of 2-entry buckets. When both entries of
+// a bucket are taken, the entry of the older iteration is replaced, and
+// between the same iteration the deeper one (larger g, smaller subtree).
+template<class PackedState> class TranspositionTable {
+public:
+	struct Entry {
+		PackedState key;
+		int g, h;
+		unsigned int iter; // 0: empty
+	};
+
+	TranspositionTable(unsigned long size) :
+			mask(0), stores(0), replaces(0) {
+		unsigned long nbuckets = 1;
+		while (nbuckets * 2 * 2 <= size)
+			nbuckets *= 2;
+		if (size >= 2) {
+			mask = nbuckets - 1;
+			tbl.resize(nbuckets * 2);
+		}
+		for (unsigned long i = 0; i < tbl.size(); ++i)
+			tbl[i].iter = 0;
+	}
+
+	Entry* find(const PackedState &k) {
+		if (tbl.empty())
+			return 0;
+		Entry* b = &tbl[(k.hash() & mask) * 2];
+		for (int i = 0; i < 2; ++i)
+			if (b[i].iter != 0 && b[i].key.eq(k))
+				return &b[i];
+		return 0;
+	}
+
+	void store(const PackedState &k, int g, int h, unsigned int iter) {
+		if (tbl.empty())
+			return;
+		Entry* b = &tbl[(k.hash() & mask) * 2];
+		Entry* e = 0;
+		for (int i = 0; i < 2 && !e; ++i)
+			if (b[i].iter == 0 || b[i].key.eq(k))
+				e = &b[i];
+		if (!e) {
+			if (b[0].iter != b[1].iter)
+				e = b[0].iter < b[1].iter ? &b[0] : &b[1];
+			else
+				e = b[0].g >= b[1].g ? &b[0] : &b[1];
+			++replaces;
+		}
+		e->key = k;
+		e->g = g;
+		e->h = h;
+		e->iter = iter;
+		++stores;
+	}
+
+	unsigned long size() const {
+		return tbl.size();
+	}
+
+private:
+	std::vector<Entry> tbl;
+	unsigned long mask;
+
+public:
+	unsigned long stores, replaces;
+};
+
+template<class D> class IdastarTT: public SearchAlg<D> {
+	std::vector<typename D::State> path;
+	int bound, minoob;
+	unsigned int iter;
+
+	TranspositionTable<typename D::PackedState> tt;
+	int min_budget;
+	unsigned long pruned, hits;
+
+public:
+
+	// ttsize is the number of entries of the transposition table.
+	// Nodes with less than min_budget left to the bound have small
+	// subtrees and do not use the table.
+	IdastarTT(D &d, unsigned long ttsize = 1 << 20, int min_budget_ = 2) :
+			SearchAlg<D>(d), bound(0), minoob(-1), iter(0), tt(ttsize), min_budget(
+					min_budget_), pruned(0), hits(0) {
+	}
+
+	virtual std::vector<typename D::State> search(typename D::State &root) {
+		bound = this->dom.h(root);
+
+		dfpair(stdout, "transposition table entries", "%lu", tt.size());
+		dfrowhdr(stdout, "iteration", 4, "number", "bound",
+				"nodes expanded", "nodes generated");
+		do {
+			minoob = -1;
+			++iter;
+			int sub;
+			dfs(root, 0, -1, -1, sub);
+			dfrow(stdout, "iteration", "uduu", (unsigned long) iter,
+					(long) bound, this->expd, this->gend);
+			bound = minoob;
+		} while (path.size() == 0 && bound >= 0);
+
+		dfpair(stdout, "transposition table hits", "%lu", hits);
+		dfpair(stdout, "transposition table prunes", "%lu", pruned);
+		dfpair(stdout, "transposition table stores", "%lu", tt.stores);
+		dfpair(stdout, "transposition table replaces", "%lu", tt.replaces);
+		return path;
+	}
+
+private:
+
+	// dfs sets sub to a lower bound of the cost of a solution through n
+	// found by this search: the smallest f beyond the bound under n,
+	// or -1 if there is no solution under n. back is the cost back to the
+	// parent plus its h, -1 at the root.
+	bool dfs(typename D::State &n, int cost, int pop, int back, int &sub) {
+		int h = this->dom.h(n);
+		sub = -1;
+
+		bool usett = bound - cost - h >= min_budget;
+		typename D::PackedState key;
+		typename TranspositionTable<typename D::PackedState>::Entry* e = 0;
+		if (usett) {
+			this->dom.pack(key, n);
+			e = tt.find(key);
+		}
+		if (e) {
+			hits++;
+			if (e->h > h)
+				h = e->h;
+			if (e->g < cost || (e->g == cost && e->iter == iter)) {
+				pruned++;
+				sub = cost + h;
+				return false;
+			}
+		}
+
+		int f = cost + h;
+
+		if (f <= bound && this->dom.isgoal(n)) {
+			path.push_back(n);
+			return true;
+		}
+
+		if (f > bound) {
+			if (minoob < 0 || f < minoob)
+				minoob = f;
+			sub = f;
+			return false;
+		}
+
+		this->expd++;
+		int nops = this->dom.nops(n);
+		for (int i = 0; i < nops; i++) {
+			int op = this->dom.nthop(n, i);
+			if (op == pop)
+				continue;
+
+			this->gend++;
+			Edge<D> e = this->dom.apply(n, op);
+			int s;
+			bool goal = dfs(n, e.cost + cost, e.pop, e.cost + h, s);
+			this->dom.undo(n, e);
+			if (goal) {
+				path.push_back(n);
+				return true;
+			}
+			if (s >= 0 && (sub < 0 || s < sub))
+				sub = s;
+		}
+
+		if (usett) {
+			int lb = sub >= 0 ? sub - cost : -1;
+			if (back >= 0 && (lb < 0 || back < lb))
+				lb = back;
+			if (lb > h)
+				h = lb;
+			tt.store(key, cost, h, iter);
+		}
+		return false;
+	}
+};
+
+#endif /* IDASTAR_TT_HPP_ */
@@ -0,0 +1,64 @@
+/*
+ * lockfree_hashtbl.hpp
+ *
+ * LockFreeHashTable is a fixed-size chained hash table, like HashTable,
+ * that any number of threads can search and add to at once without
+ * locks. A node is linked in front of its chain with a compare-and-swap
+ * on the bucket; nothing is ever removed. insert only adds a node if no
+ * equal one is in, so exactly one of the threads adding the same state
+ * wins.
+ */
+
+#ifndef LOCKFREE_HASHTBL_HPP_
+#define LOCKFREE_HASHTBL_HPP_
+
+#include <vector>
+#include <atomic>
+
+#include "hashtbl.hpp"
+
+template<class Key, class Node> class LockFreeHashTable {
+
+	std::vector<std::atomic<Node*> > buckets;
+
+public:
+
+	// buckets are all NULL pointers.
+	LockFreeHashTable(unsigned int sz) :
+			buckets(sz) {
+		for (unsigned int i = 0; i < sz; ++i)
+			buckets[i].store(0, std::memory_order_relaxed);
+	}
+
+	// find returns the node with the given key or 0.
+	Node *find(const Key &key) {
+		unsigned long h = key.hash();
+		Node *p = buckets[h % buckets.size()].load(std::memory_order_acquire);
+		for (; p; p = p->hashentry().next)
+			if (p->hashentry().hash == h && p->key().eq(key))
+				return p;
+		return 0;
+	}
+
+	// insert adds n unless a node with its key is in, and returns the
+	// node in the table.
+	Node *insert(Node *n) {
+		unsigned long h = n->key().hash();
+		std::atomic<Node*> &bucket = buckets[h % buckets.size()];
+		n->hashentry().hash = h;
+		Node *head = bucket.load(std::memory_order_acquire);
+		Node *seen = 0; // chain below it was searched already
+		for (;;) {
+			for (Node *p = head; p != seen; p = p->hashentry().next)
+				if (p->hashentry().hash == h && p->key().eq(n->key()))
+					return p;
+			n->hashentry().next = head;
+			seen = head;
+			if (bucket.compare_exchange_weak(head, n,
+					std::memory_order_release, std::memory_order_acquire))
+				return n;
+		}
+	}
+};
+
+#endif /* LOCKFREE_HASHTBL_HPP_ */
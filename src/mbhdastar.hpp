@@ -0,0 +1,273 @@
+/*
+ * mbhdastar.hpp
+ *
+ * Memory-bounded HDA*. HDA* runs until the node pools of its threads
+ * hold memory_budget bytes (HDAstar::set_memory_budget). The open lists
+ * are then frozen and the search goes on as parallel IDA* from every
+ * frozen open node, the threads taking the nodes in order of f.
+ *
+ * The closed lists and the frozen nodes are a read-only transposition
+ * filter for the IDA* phase: a state held there with g no larger than
+ * the g it is reached with is pruned, as a frozen node covers every path
+ * on through it. The optimal path passes through a frozen node after the
+ * last state the filter holds with its optimal g, and is never pruned
+ * after it.
+ */
+
+#ifndef MBHDASTAR_HPP_
+#define MBHDASTAR_HPP_
+
+#include "hdastar.hpp"
+#include "search.hpp"
+#include "utils.hpp"
+#include "hashtbl.hpp"
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <pthread.h>
+
+template<class D> class MBHDAstar: public SearchAlg<D> {
+	typedef typename HDAstar<D>::Node Node;
+
+	int tnum;
+	unsigned long memory_budget;
+	unsigned int closedlistsize;
+	int min_budget;
+
+	typename HDAstar<D>::Arena* arena;
+	HashTable<typename D::PackedState, Node>* frontier_tbl;
+	std::vector<Node*> frontier; // sorted by f
+
+	int bound;
+	std::atomic<int> minoob;
+	std::atomic<bool> found;
+	std::atomic<unsigned long> next_root;
+	std::atomic<int> thread_id;
+	pthread_mutex_t path_m;
+
+	std::vector<unsigned long> expd_distribution, gend_distribution;
+	std::vector<unsigned long> filtered;
+
+	std::vector<typename D::State> path;
+
+public:
+
+	// memory_budget is in bytes of nodes. Nodes with less than min_budget
+	// left to the bound do not use the transposition filter.
+	MBHDAstar(D &d, int tnum, unsigned long memory_budget,
+			unsigned int closedlistsize = 110503, int min_budget = 2) :
+			SearchAlg<D>(d), tnum(tnum), memory_budget(memory_budget), closedlistsize(
+					closedlistsize), min_budget(min_budget), arena(0), frontier_tbl(
+					0), bound(0), minoob(-1), found(false), next_root(0), thread_id(
+					0) {
+		pthread_mutex_init(&path_m, NULL);
+		expd_distribution.resize(tnum);
+		gend_distribution.resize(tnum);
+		filtered.resize(tnum);
+	}
+
+	~MBHDAstar() {
+		delete frontier_tbl;
+		delete arena;
+		pthread_mutex_destroy(&path_m);
+	}
+
+	std::vector<typename D::State> search(typename D::State &init) {
+		// The nodes of an earlier search go with its arena.
+		delete frontier_tbl;
+		frontier_tbl = 0;
+		frontier.clear();
+		found = false;
+		for (int i = 0; i < tnum; ++i)
+			filtered[i] = 0;
+		delete arena;
+		arena = new typename HDAstar<D>::Arena(tnum, closedlistsize);
+		HDAstar<D> hda(this->dom, tnum, 1000000, 10000000, 0, 0, closedlistsize);
+		hda.set_arena(arena);
+		hda.set_memory_budget(memory_budget);
+		path = hda.search(init);
+		this->expd = hda.expd;
+		this->gend = hda.gend;
+		this->dup = hda.dup;
+		if (!hda.frozen_open())
+			return path;
+
+		dfpair(stdout, "HDA* nodes expanded before freezing", "%lu", hda.expd);
+		build_frontier(hda);
+		dfpair(stdout, "frozen open nodes", "%lu", frontier.size());
+
+		int incumbent = hda.incumbent;
+		std::vector<typename D::State> hda_path = path;
+		path.clear();
+
+		bound = frontier.empty() ? -1 : f(frontier[0]);
+		dfrowhdr(stdout, "iteration", 3, "bound", "nodes expanded",
+				"nodes generated");
+		while (bound >= 0 && bound < incumbent && path.empty()) {
+			minoob = -1;
+			next_root = 0;
+			thread_id = 0;
+			std::vector<pthread_t> t(tnum);
+			for (int i = 0; i < tnum; ++i)
+				pthread_create(&t[i], NULL, &MBHDAstar::thread_helper, this);
+			for (int i = 0; i < tnum; ++i)
+				pthread_join(t[i], NULL);
+			for (int i = 0; i < tnum; ++i) {
+				this->expd += expd_distribution[i];
+				this->gend += gend_distribution[i];
+				expd_distribution[i] = 0;
+				gend_distribution[i] = 0;
+			}
+			dfrow(stdout, "iteration", "duu", (long) bound, this->expd,
+					this->gend);
+			bound = minoob;
+		}
+		if (path.empty())
+			path = hda_path;
+
+		unsigned long filt = 0;
+		for (int i = 0; i < tnum; ++i)
+			filt += filtered[i];
+		dfpair(stdout, "IDA* nodes filtered", "%lu", filt);
+		return path;
+	}
+
+private:
+
+	int f(Node *n) const {
+		typename D::State s;
+		this->dom.unpack(s, n->packed);
+		return n->g + this->dom.h(s);
+	}
+
+	// build_frontier collects the frozen nodes, keeping the one with the
+	// smallest g of each state that is not closed with a g as small.
+	void build_frontier(HDAstar<D> &hda) {
+		std::vector<Node*> all;
+		for (int i = 0; i < tnum; ++i)
+			all.insert(all.end(), hda.frozen[i].begin(), hda.frozen[i].end());
+		std::sort(all.begin(), all.end(), [](Node* a, Node* b) {
+			return a->g < b->g;
+		});
+
+		frontier_tbl = new HashTable<typename D::PackedState, Node>(
+				closedlistsize);
+		std::vector<std::pair<int, Node*> > byf;
+		for (unsigned int i = 0; i < all.size(); ++i) {
+			Node *n = all[i];
+			Node *c = closed_find(n->packed);
+			if (c && c != n && c->g <= n->g)
+				continue;
+			if (frontier_tbl->find(n->packed))
+				continue;
+			// A node put back by partial expansion is closed already.
+			if (c != n)
+				frontier_tbl->add(n);
+			byf.push_back(std::make_pair(f(n), n));
+		}
+		std::stable_sort(byf.begin(), byf.end(),
+				[](const std::pair<int, Node*> &a,
+						const std::pair<int, Node*> &b) {
+					return a.first < b.first;
+				});
+		for (unsigned int i = 0; i < byf.size(); ++i)
+			frontier.push_back(byf[i].second);
+	}
+
+	Node* closed_find(typename D::PackedState &p) {
+		typename D::State s;
+		this->dom.unpack(s, p);
+		return arena->closed[this->dom.dist_hash(s) % tnum]->find(p);
+	}
+
+	static void* thread_helper(void* arg) {
+		static_cast<MBHDAstar*>(arg)->thread_search();
+		return 0;
+	}
+
+	void thread_search() {
+		int id = thread_id.fetch_add(1);
+		unsigned long expd = 0, gend = 0, filt = 0;
+		for (unsigned long i = next_root.fetch_add(1);
+				i < frontier.size() && !found; i = next_root.fetch_add(1)) {
+			Node *root = frontier[i];
+			typename D::State s;
+			this->dom.unpack(s, root->packed);
+			std::vector<typename D::State> sub;
+			if (dfs(s, root->g, root->pop, root, sub, expd, gend, filt)) {
+				pthread_mutex_lock(&path_m);
+				if (path.empty()) {
+					path = sub;
+					for (Node *p = root->parent; p; p = p->parent) {
+						typename D::State ps;
+						this->dom.unpack(ps, p->packed);
+						path.push_back(ps);
+					}
+				}
+				pthread_mutex_unlock(&path_m);
+				found = true;
+			}
+		}
+		expd_distribution[id] = expd;
+		gend_distribution[id] = gend;
+		filtered[id] += filt;
+	}
+
+	// pruned returns true if the filter holds n with a g no larger than g.
+	bool pruned(typename D::State &n, int g, Node *root) {
+		typename D::PackedState p;
+		this->dom.pack(p, n);
+		Node *e = frontier_tbl->find(p);
+		if (e && e != root && e->g <= (unsigned int) g)
+			return true;
+		e = arena->closed[this->dom.dist_hash(n) % tnum]->find(p);
+		return e && e != root && e->g <= (unsigned int) g;
+	}
+
+	bool dfs(typename D::State &n, int g, int pop, Node *root,
+			std::vector<typename D::State> &sub, unsigned long &expd,
+			unsigned long &gend, unsigned long &filt) {
+		int f = g + this->dom.h(n);
+
+		if (f <= bound && this->dom.isgoal(n)) {
+			sub.push_back(n);
+			return true;
+		}
+
+		if (f > bound) {
+			int m = minoob.load();
+			while ((m < 0 || f < m) && !minoob.compare_exchange_weak(m, f))
+				;
+			return false;
+		}
+
+		if (found)
+			return false;
+
+		if (bound - f >= min_budget && g > (int) root->g
+				&& pruned(n, g, root)) {
+			++filt;
+			return false;
+		}
+
+		++expd;
+		int nops = this->dom.nops(n);
+		for (int i = 0; i < nops; i++) {
+			int op = this->dom.nthop(n, i);
+			if (op == pop)
+				continue;
+			++gend;
+			Edge<D> e = this->dom.apply(n, op);
+			bool goal = dfs(n, g + e.cost, e.pop, root, sub, expd, gend, filt);
+			this->dom.undo(n, e);
+			if (goal) {
+				sub.push_back(n);
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+#endif /* MBHDASTAR_HPP_ */
@@ -15,10 +15,15 @@
 #include <math.h>
 #include <algorithm>
 #include <array>
+#include <climits>
 
 #include "../search.hpp"
 #include "../utils.hpp"
+#include "../fatal.hpp"
 #include "hashtbl_mpi.hpp"
+#include "mpi_transport.hpp"
+#include "rma_transport.hpp"
+#include "wire_format.hpp"
 //#include "hashtblbig.hpp"
 #include "../heap.hpp"
 //#include "pool.hpp"
@@ -35,16 +40,18 @@
 //#define DELAY 0
 
 #define MPI_MSG_NODE 0 // node
-#define MPI_MSG_INCM 1 // for updating incumbent. message is unsigned int.
-#define MPI_MSG_TERM 2 // for termination.message is empty.
-#define MPI_MSG_FTERM 3 // broadcast this message when process terminated.
+#define MPI_MSG_PATH 1 // path reconstruction (reconstructPath).
+// Termination and the incumbent go by MPI_Iallreduce (terminationDetection).
 template<class D> class HDAstarCombMPI: public SearchAlg<D> {
 
 	struct Node {
 		unsigned int f, g;
 		unsigned int zbr; // zobrist value. stored here for now. Also the size is char for now.
 		int openind;
-//		Node *parent; // TODO: somehow need to hold this info
+		// The parent is closed_nodes[parent_index] of rank parent_rank,
+		// -1 for the initial node.
+		int parent_rank;
+		unsigned int parent_index;
 		HashEntry<Node> hentry;
 		char pop;
 		typename D::PackedState packed;
@@ -54,9 +61,6 @@ template<class D> class HDAstarCombMPI: public SearchAlg<D> {
 				return g > o->g;
 			return f < o->f;
 		}
-		const unsigned int size() {
-			return 25 + packed.byteSize();
-		}
 		HashEntry<Node> &hashentry() {
 			return hentry;
 		}
@@ -65,69 +69,6 @@ template<class D> class HDAstarCombMPI: public SearchAlg<D> {
 		}
 	};
 
-	/**
-	 * Char representation of the Node:
-	 *
-	 * 0-3:   f
-	 * 4-7:   g
-	 * 8-11:  zbr
-	 * 12-15: openind
-	 * 16-19: hash (hentry.hash)
-	 * 20:    pop
-	 * 21-24: packed size
-	 * 25-:   packed state representation
-	 *
-	 */
-
-	void uintToChars(unsigned int p, unsigned char* d) {
-		int n = sizeof p;
-		for (int y = 0; n-- > 0; y++)
-			d[y] = (p >> (n * 8)) & 0xff;
-	}
-	template<typename T>
-	void charsToData(T& p, unsigned char* d) {
-		int n = sizeof p;
-		p = 0;
-		for (int i = 0; i < n; ++i) {
-			p += (T) d[i] << (8 * (n - i - 1));
-		}
-	}
-
-	void nodeToChars(Node* n, unsigned char* d) {
-		uintToChars(n->f, &(d[0]));
-		uintToChars(n->g, &(d[4]));
-		uintToChars(n->zbr, &(d[8]));
-		uintToChars(n->openind, &(d[12]));
-		uintToChars(n->hentry.hash, &(d[16]));
-		d[20] = n->pop;
-		unsigned int state_size = n->packed.byteSize();
-		uintToChars(state_size, &(d[21]));
-
-		n->packed.stateToChars(&(d[25]));
-	}
-
-	void charsToNode(unsigned char* d, Node& n) {
-		charsToData(n.f, &(d[0]));
-		charsToData(n.g, &(d[4]));
-		charsToData(n.zbr, &(d[8]));
-		charsToData(n.openind, &(d[12]));
-		charsToData(n.hentry.hash, &(d[16]));
-		n.pop = d[20];
-		n.packed.charsToState(&(d[25]));
-	}
-
-	void charsToNodes(unsigned char* d, const unsigned int dsize,
-			std::vector<Node*>& nodes) {
-		unsigned int dp = 0;
-		unsigned int nsize = 0;
-		while (dp < dsize) {
-			Node* p = new Node();
-			charsToNode(&(d[dp]), *p);
-			nodes.push_back(p);
-			dp += p->size();
-		}
-	}
-
 	void print(Node* n) {
 		printf("state = %ud\n", n->packed.word);
 		printf("f,g = %ud, %ud\n", n->f, n->g);
@@ -169,7 +110,25 @@ template<class D> class HDAstarCombMPI: public SearchAlg<D> {
 	////////////////////////
 	/// MPI
 	////////////////////////
-	unsigned char* mpi_buffer;
+	MPITransport two_sided; // MPI_MSG_NODE
+	RMATransport one_sided;
+	Transport* transport; // one of the two
+	WireFormat<Node> wire;
+	unsigned long nodes_sent = 0;
+	unsigned long nodes_received = 0;
+
+	std::vector<Node*> closed_nodes; // closed nodes of this rank by index
+	Node* goal = 0; // best goal found on this rank
+
+	// Termination wave: a sum of (nodes sent, nodes received, busy, stop)
+	// and a min of the incumbent over the ranks.
+	MPI_Request wave[2];
+	bool in_wave = false;
+	long long wave_sums[4], wave_total[4], wave_last = -1;
+	int wave_inc, wave_min_inc;
+	unsigned long waves = 0;
+	double last_work = 0; // MPI_Wtime when the rank last ran out of work
+	double idle_time = 0; // seconds without work
 
 #ifdef ANALYZE_INCOME
 	int max_income = 0;
@@ -205,7 +164,8 @@ public:
 			unsigned int closedlistsize = 1105036, unsigned int openlistsize =
 					100, unsigned int maxcost = 1000000) :
 			SearchAlg<D>(d), tnum(tnum_), incumbent(maxcost), outgo_threshold(
-					outgo_threshold_), overrun(overrun_), closedlistsize(
+					outgo_threshold_), two_sided(MPI_MSG_NODE), transport(
+					&two_sided), overrun(overrun_), closedlistsize(
 					closedlistsize), openlistsize(openlistsize), initmaxcost(
 					maxcost) {
 
@@ -229,14 +189,29 @@ public:
 		this->closedlistsize = closedlistsize;
 	}
 
+	// set_wire_format selects how nodes are encoded in messages
+	// (wire_format.hpp). The default is WireFormat::RAW.
+	void set_wire_format(typename WireFormat<Node>::Format format) {
+		wire.set_format(format);
+	}
+
+	enum TransportKind {
+		TWO_SIDED, ONE_SIDED,
+	};
+
+	// set_transport selects how nodes are sent: MPI_Isend to persistent
+	// receives (mpi_transport.hpp, the default) or MPI_Put to the income
+	// window of the receiver (rma_transport.hpp).
+	void set_transport(TransportKind kind) {
+		transport = kind == ONE_SIDED ? (Transport*) &one_sided : &two_sided;
+	}
+
 //      32,334 length 46 : 14 1 9 6 4 8 12 5 7 2 3 0 10 11 13 15
 //     909,442 length 53 : 13 14 6 12 4 5 1 0 9 3 10 2 15 11 8 7
 //   5,253,685 length 57 : 5 12 10 7 15 11 14 0 8 2 1 13 3 4 9 6
 // 565,994,203 length ?? : 14 7 8 2 13 11 10 4 9 12 5 0 3 6 1 15
 //	template<class heap>
 	void thread_search() {
-		MPI_Status status;
-		MPI_Request request;
 //		int world_size; // = tnum!
 //		MPI_Comm_size(MPI_COMM_WORLD, &world_size);
 
@@ -298,7 +273,9 @@ public:
 //			;
 //		}
 		int loop_count = 0;
-		bool has_sent_first_term = false; // this field is only for id == 0.
+		bool stop = false;
+		bool working = true;
+		last_work = MPI_Wtime();
 
 		if (id == 0) {
 			// wrap a new node.
@@ -307,7 +284,8 @@ public:
 				n->g = 0;
 				n->f = this->dom.h(init);
 				n->pop = -1;
-				//			n->parent = 0;
+				n->parent_rank = -1;
+				n->parent_index = 0;
 				this->dom.pack(n->packed, init);
 			}
 			open.push(n);
@@ -320,17 +298,15 @@ public:
 						gend_here);
 			}
 
-			int has_received = 0;
-
 			Node *n;
 
 			if (this->isTimed) {
 				double t = walltime() - init_time;
 //				printf("t = %f\n", t);
-				if (t > this->timer) {
+				if (t > this->timer && !stop) {
 //					closed.destruct_all(nodes);
 					printf("Terminated due to timer\n");
-					break;
+					stop = true;
 				}
 			}
 
@@ -351,31 +327,29 @@ public:
 			open_sizes[id] = open.getsize();
 #endif
 
-//			if (open.isemptyunder(incumbent.load())) {
-			has_received = 0;
-			MPI_Iprobe(MPI_ANY_SOURCE, MPI_MSG_INCM, MPI_COMM_WORLD,
-					&has_received, &status);
-			if (has_received) {
-				int newincm;
-				MPI_Recv(&newincm, 1, MPI_INT, MPI_ANY_SOURCE, MPI_MSG_INCM,
-						MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-				if (incumbent > newincm) {
-					incumbent = newincm;
+			if (terminationDetection(open, outgo_buffer, stop)) {
+				printf("%d terminated\n", id);
+				if (!working) {
+					idle_time += MPI_Wtime() - last_work;
 				}
-				printf("incumbent = %d\n", incumbent);
+				break;
 			}
 
 			if (open.isemptyunder(incumbent)) {
-				flushOutgoBuffers(outgo_buffer, 0);
-				if (terminationDetection(has_sent_first_term)) {
-					printf("%d terminated\n", id);
-					break;
+				// Not idle while a send ring is full.
+				if (!flushOutgoBuffers(outgo_buffer, 0)) {
+					continue;
+				}
+				if (working) {
+					last_work = MPI_Wtime();
+					working = false;
 				}
 				continue;
 			}
-
-			// Reset as we got a new work node.
-			has_sent_first_term = false;
+			if (!working) {
+				idle_time += MPI_Wtime() - last_work;
+				working = true;
+			}
 
 			n = static_cast<Node*>(open.pop());
 //			printf("%d: f,g = %d, %d\n", id, n->f, n->g);
@@ -475,8 +449,6 @@ public:
 //					printf("isgoal ERROR\n");
 //					continue;
 //				}
-				std::vector<typename D::State> newpath;
-
 //				for (Node *p = n; p; p = p->parent) {
 //					typename D::State s;
 //					this->dom.unpack(s, p->packed);
@@ -491,14 +463,7 @@ public:
 //					LogIncumbent* li = new LogIncumbent(walltime() - wall0,
 //							incumbent);
 //					logincumbent[id].push_back(*li);
-					path = newpath;
-				}
-
-				for (int i = 0; i < tnum; ++i) {
-					if (i != id) {
-						MPI_Isend(&incumbent, 1, MPI_INT, i, MPI_MSG_INCM,
-								MPI_COMM_WORLD, &request);
-					}
+					goal = n;
 				}
 				continue;
 			}
@@ -509,6 +474,8 @@ public:
 #else
 			closed.add(n);
 #endif
+			unsigned int index = closed_nodes.size();
+			closed_nodes.push_back(n);
 			expd_here++;
 			//		printf("expd: %d\n", id);
 
@@ -546,6 +513,8 @@ public:
 //				int blank = state.blank; // Make this available for Grid pathfinding.
 				Edge<D> e = this->dom.apply(state, op);
 				Node* next = wrap(state, n, e.cost, e.pop);
+				next->parent_rank = id;
+				next->parent_index = index;
 
 				///////////////////////////
 				/// TESTS
@@ -676,130 +645,192 @@ public:
 	}
 
 	void receiveNodes(Heap<Node>& open) {
-		MPI_Status status;
-		int has_received = 0;
-		MPI_Iprobe(MPI_ANY_SOURCE, MPI_MSG_NODE, MPI_COMM_WORLD, &has_received,
-				&status);
-		while (has_received != 0) {
-			int income_size = 0;
-			MPI_Get_count(&status, MPI_BYTE, &income_size);
-
-//				printf("%d recieved %d bytes\n", id, income_size);
-			//			tmp.resize(income_size / sizeof(Node));
-
-			unsigned char *d = new unsigned char[income_size];
-			MPI_Recv(d, income_size, MPI_BYTE, MPI_ANY_SOURCE, MPI_MSG_NODE,
-					MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-			// TODO: use Memory Pool for nodes in local
-//				Node* tmpn = new Node();
-//				charsToNode(d, *tmpn);
-//				open.push(tmpn);
-			std::vector<Node*> nodes;
-			charsToNodes(d, income_size, nodes);
-
+		unsigned char *d;
+		int income_size;
+		std::vector<Node*> nodes;
+		while (transport->poll(d, income_size)) {
+			wire.decode(d, income_size, nodes);
+			transport->release();
+			nodes_received += nodes.size();
 			for (int i = 0; i < nodes.size(); ++i) {
 				open.push(nodes[i]);
 			}
-
-//				printf("received f,g = %d %d\n", tmpn->f, tmpn->g);
-			delete[] d;
 			nodes.clear();
-
-			has_received = 0;
-			MPI_Iprobe(MPI_ANY_SOURCE, MPI_MSG_NODE, MPI_COMM_WORLD,
-					&has_received, &status);
 		}
 	}
 
-	// check if its optimal.
-	bool terminationDetection(bool& has_sent_first_term) {
-		MPI_Status status;
-		int has_received = 0;
-
-		MPI_Iprobe(MPI_ANY_SOURCE, MPI_MSG_FTERM, MPI_COMM_WORLD, &has_received,
-				MPI_STATUS_IGNORE);
-		if (has_received) {
-			printf("received fterm\n");
-			return true;
-		}
-
-		if (id == 0 && !has_sent_first_term) {
-			// TODO: how can we maintain the memory while MPI_Isend is executing?
-			unsigned char term = 0;
-			MPI_Bsend(&term, 1, MPI_BYTE, (id + 1) % tnum, MPI_MSG_TERM,
-					MPI_COMM_WORLD);
-			printf("sent first term\n");
-			has_sent_first_term = true;
-			sleep(1);
-		}
-
-		has_received = 0;
-		MPI_Iprobe((id - 1) % tnum, MPI_MSG_TERM, MPI_COMM_WORLD, &has_received,
-				&status);
-		if (has_received) {
-			int term = 0;
-			MPI_Recv(&term, 1, MPI_BYTE, (id - 1) % tnum, MPI_MSG_TERM,
-					MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-			if (id == 0) {
-				++term;
+	// terminationDetection keeps one wave in flight and returns true once
+	// the search is over on every rank: two waves in a row found no rank
+	// busy and as many nodes sent as received (the four-counter method),
+	// or a rank is out of time. A wave also takes the min incumbent.
+	// A rank is busy while it has an open node under the incumbent or
+	// nodes in its outgo buffers.
+	bool terminationDetection(Heap<Node>& open,
+			std::vector<std::vector<Node>>& outgo_buffer, bool stop) {
+		if (in_wave) {
+			int complete;
+			MPI_Testall(2, wave, &complete, MPI_STATUSES_IGNORE);
+			if (!complete) {
+				return false;
 			}
-
-			printf("%d received term %d\n", id, term);
-			MPI_Bsend(&term, 1, MPI_BYTE, (id + 1) % tnum, MPI_MSG_TERM,
-					MPI_COMM_WORLD);
-			if (term > 1) {
+			in_wave = false;
+			++waves;
+			if (wave_min_inc < incumbent) {
+				incumbent = wave_min_inc;
+				printf("incumbent = %d\n", incumbent);
+			}
+			bool quiet = wave_total[2] == 0 && wave_total[0] == wave_total[1];
+			if (wave_total[3] > 0 || (quiet && wave_total[0] == wave_last)) {
 				return true;
 			}
+			wave_last = quiet ? wave_total[0] : -1;
+		}
+		bool busy = !open.isemptyunder(incumbent);
+		for (int i = 0; i < tnum && !busy; ++i) {
+			busy = !outgo_buffer[i].empty();
+		}
+		wave_sums[0] = nodes_sent;
+		wave_sums[1] = nodes_received;
+		wave_sums[2] = busy;
+		wave_sums[3] = stop;
+		wave_inc = incumbent;
+		MPI_Iallreduce(wave_sums, wave_total, 4, MPI_LONG_LONG, MPI_SUM,
+				MPI_COMM_WORLD, &wave[0]);
+		MPI_Iallreduce(&wave_inc, &wave_min_inc, 1, MPI_INT, MPI_MIN,
+				MPI_COMM_WORLD, &wave[1]);
+		in_wave = true;
+		return false;
+	}
 
-			MPI_Iprobe((id - 1) % tnum, MPI_MSG_TERM, MPI_COMM_WORLD,
-					&has_received, &status);
+	// reconstructPath walks back from the best goal to the initial node.
+	// The rank that found the goal asks the owner of each node on the way
+	// for its packed state and parent (MPI_MSG_PATH with the index, answered
+	// with the parent rank and index and the state); the other ranks answer
+	// until an empty message. The path is then broadcast to every rank.
+	void reconstructPath() {
+		typedef StateWire<typename D::PackedState, false> Chars;
+		struct {
+			int g, rank;
+		} mine, best;
+		mine.g = goal ? goal->g : INT_MAX;
+		mine.rank = id;
+		MPI_Allreduce(&mine, &best, 1, MPI_2INT, MPI_MINLOC, MPI_COMM_WORLD);
+		if (best.g == INT_MAX) {
+			return;
+		}
 
-			// This while loop is here to flush all messages
-			while (has_received) {
-				MPI_Recv(&term, 1, MPI_BYTE, (id - 1) % tnum, MPI_MSG_TERM,
+		std::vector<unsigned char> chars, msg;
+		if (best.rank == id) {
+			appendState(chars, goal->packed);
+			int rank = goal->parent_rank;
+			unsigned int index = goal->parent_index;
+			while (rank >= 0) {
+				if (rank == id) {
+					Node* p = closed_nodes[index];
+					appendState(chars, p->packed);
+					rank = p->parent_rank;
+					index = p->parent_index;
+					continue;
+				}
+				MPI_Send(&index, 1, MPI_UNSIGNED, rank, MPI_MSG_PATH,
+						MPI_COMM_WORLD);
+				MPI_Status status;
+				int size;
+				MPI_Probe(rank, MPI_MSG_PATH, MPI_COMM_WORLD, &status);
+				MPI_Get_count(&status, MPI_BYTE, &size);
+				msg.resize(size);
+				MPI_Recv(&msg[0], size, MPI_BYTE, rank, MPI_MSG_PATH,
 						MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-				if (term == 1) {
-					printf("%d received term %d\n", id, term);
-					MPI_Bsend(&term, 1, MPI_BYTE, (id + 1) % tnum, MPI_MSG_TERM,
-							MPI_COMM_WORLD);
-					return true;
+				memcpy(&rank, &msg[0], 4);
+				memcpy(&index, &msg[4], 4);
+				chars.insert(chars.end(), msg.begin() + 8, msg.end());
+			}
+			for (int i = 0; i < tnum; ++i) {
+				if (i != id) {
+					MPI_Send(0, 0, MPI_BYTE, i, MPI_MSG_PATH, MPI_COMM_WORLD);
 				}
-				has_received = 0;
-				MPI_Iprobe((id - 1) % tnum, MPI_MSG_TERM, MPI_COMM_WORLD,
-						&has_received, &status);
 			}
+		} else {
+			while (true) {
+				MPI_Status status;
+				int size;
+				MPI_Probe(best.rank, MPI_MSG_PATH, MPI_COMM_WORLD, &status);
+				MPI_Get_count(&status, MPI_BYTE, &size);
+				if (size == 0) {
+					MPI_Recv(0, 0, MPI_BYTE, best.rank, MPI_MSG_PATH,
+							MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+					break;
+				}
+				unsigned int index;
+				MPI_Recv(&index, 1, MPI_UNSIGNED, best.rank, MPI_MSG_PATH,
+						MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+				Node* p = closed_nodes[index];
+				msg.resize(8);
+				memcpy(&msg[0], &p->parent_rank, 4);
+				memcpy(&msg[4], &p->parent_index, 4);
+				appendState(msg, p->packed);
+				MPI_Send(&msg[0], msg.size(), MPI_BYTE, best.rank,
+						MPI_MSG_PATH, MPI_COMM_WORLD);
+			}
+		}
 
+		unsigned int size = chars.size();
+		MPI_Bcast(&size, 1, MPI_UNSIGNED, best.rank, MPI_COMM_WORLD);
+		chars.resize(size);
+		MPI_Bcast(&chars[0], size, MPI_BYTE, best.rank, MPI_COMM_WORLD);
+		const unsigned char* c = &chars[0];
+		while (c < &chars[0] + size) {
+			typename D::PackedState packed;
+			c = Chars::get(packed, c);
+			typename D::State s;
+			this->dom.unpack(s, packed);
+			path.push_back(s);
 		}
-		return false;
 	}
 
-	void flushOutgoBuffers(std::vector<std::vector<Node>>& outgo_buffer,
+	// appendState appends the length and stateToChars of packed to chars.
+	void appendState(std::vector<unsigned char>& chars,
+			typename D::PackedState& packed) {
+		unsigned int at = chars.size();
+		chars.resize(at + 5 + packed.byteSize());
+		unsigned char* end = StateWire<typename D::PackedState, false>::put(
+				packed, &chars[at]);
+		chars.resize(end - &chars[0]);
+	}
+
+	// flushOutgoBuffers sends the outgo buffers holding more than
+	// thresould nodes, as many nodes to a message as a slot holds.
+	// A node larger than a slot throws Fatal.
+	// Returns false if a send ring was full and nodes are left.
+	bool flushOutgoBuffers(std::vector<std::vector<Node>>& outgo_buffer,
 			int thresould) {
+		bool flushed = true;
 		for (int i = 0; i < tnum; ++i) {
-			if (i != id && outgo_buffer[i].size() > thresould) {
-				unsigned int totsize = 0;
-				for (int j = 0; j < outgo_buffer[i].size(); ++j) {
-					totsize += outgo_buffer[i][j].size();
-				}
-				unsigned char* d = new unsigned char[totsize];
-				unsigned char* dp = d;
-				for (int j = 0; j < outgo_buffer[i].size(); ++j) {
-					Node send = outgo_buffer[i][j];
-					nodeToChars(&send, dp);
-//						MPI_Isend(d, send.size(), MPI_BYTE, i, MPI_MSG_NODE,
-//								MPI_COMM_WORLD, &request);
-					// TODO: asynchronzie it like try_lock.
-					MPI_Bsend(dp, send.size(), MPI_BYTE, i, MPI_MSG_NODE,
-							MPI_COMM_WORLD);
-//						printf("sent f,g = %d %d\n", send.f, send.g);
-					dp += send.size();
+			if (i == id || outgo_buffer[i].size() <= thresould) {
+				continue;
+			}
+			unsigned int j = 0;
+			while (j < outgo_buffer[i].size()) {
+				unsigned char* d = transport->acquire(i);
+				if (!d) {
+					flushed = false;
+					break;
 				}
-				delete[] d;
-				outgo_buffer[i].clear();
+				unsigned int size = 0;
+				unsigned int k = wire.encode(&outgo_buffer[i][j],
+						outgo_buffer[i].size() - j, d, transport->slot_bytes(),
+						size);
+				if (k == 0)
+					throw Fatal("HDAstarCombMPI: a node does not fit in a %u "
+							"byte slot", transport->slot_bytes());
+				transport->post(i, size);
+				nodes_sent += k;
+				j += k;
 			}
+			outgo_buffer[i].erase(outgo_buffer[i].begin(),
+					outgo_buffer[i].begin() + j);
 		}
+		return flushed;
 	}
 
 	std::vector<typename D::State> search(typename D::State &init) {
@@ -810,22 +841,7 @@ public:
 		MPI_Comm_rank(MPI_COMM_WORLD, &id);
 		printf("id=%d\n", id);
 
-		unsigned int node_size = 32;
-		unsigned int threshold = 100;
-		// Buffer
-		unsigned int buffer_size = (node_size + MPI_BSEND_OVERHEAD) * world_size
-				* 100
-				+ (node_size * threshold + MPI_BSEND_OVERHEAD) * world_size
-						* 10000;
-		unsigned int buffer_max = 400000000; // 400 MB TODO: not sure this is enough or too much.
-		if (buffer_size > buffer_max) {
-			buffer_size = 400000000;
-		}
-
-		printf("buffersize=%u\n", buffer_size);
-		mpi_buffer = new unsigned char[buffer_size];
-		std::fill(mpi_buffer, mpi_buffer + buffer_size, 0);
-		MPI_Buffer_attach((void *) mpi_buffer, buffer_size);
+		transport->start();
 
 		this->init = init;
 
@@ -844,6 +860,19 @@ public:
 //		thread_search<Heap>();
 		thread_search();
 
+		// Time from the last rank running out of work to the end of the
+		// search on every rank. Across hosts this needs synchronized
+		// clocks (MPI_WTIME_IS_GLOBAL).
+		double times[2] = { last_work, MPI_Wtime() }, latest[2];
+		MPI_Allreduce(times, latest, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+		if (!this->isTimed) {
+			double t = walltime();
+			reconstructPath();
+			printf("path length = %lu\n", path.size());
+			printf("path reconstruction time = %f\n", walltime() - t);
+		}
+
 //		for (int i = 0; i < tnum; ++i) {
 ////			printf("%d\n", i);
 //			pthread_create(&(t[i]), NULL,
@@ -902,6 +931,21 @@ public:
 #endif
 		printf("forcepush incomebuffer = %d\n", force_income);
 		printf("forcepush outgobuffer = %d\n", force_outgo);
+		printf("node messages sent = %lu\n", transport->sent);
+		printf("node bytes sent = %lu\n", transport->sent_bytes);
+		printf("node messages received = %lu\n", transport->received);
+		printf("send ring full = %lu\n", transport->full);
+		printf("node bytes per node = %.2f\n",
+				nodes_sent ? (double) transport->sent_bytes / nodes_sent : 0.0);
+		printf("node messages per second = %.0f\n",
+				transport->sent / (walltime() - wall0));
+		printf("termination waves = %lu\n", waves);
+		printf("termination latency = %f\n", latest[1] - latest[0]);
+		// One line for each rank, read by bench/bench_mpi.sh.
+		printf("rank stats = %d %lu %lu %lu %lu %lu %lu %f %f\n", id,
+				this->expd, this->gend, this->lpush, transport->sent,
+				transport->sent_bytes, transport->polls, idle_time,
+				latest[1] - latest[0]);
 
 #ifdef ANALYZE_FTRACE
 		for (int i = 0; i < tnum; ++i) {
@@ -1009,77 +1053,9 @@ public:
 		MPI_Barrier(MPI_COMM_WORLD);
 
 
-		MPI_Status status;
 		printf("Flushing all incoming messages... ");
-
-//		int messages = {MPI_MSG_FTERM, MPI_MSG_INCM, MPI_MSG_NODE, MPI_MSG_TERM};
-		unsigned char* dummy = new unsigned char[10 * 10000];
-
-//		for (int i = 0; i < 4; ++i) {
-//
-//		}
-
-		int has_received = 1;
-		while (has_received) {
-			has_received = 0;
-			MPI_Iprobe(MPI_ANY_SOURCE, MPI_MSG_FTERM, MPI_COMM_WORLD, &has_received,
-					MPI_STATUS_IGNORE);
-			if (has_received) {
-				MPI_Recv(dummy, 0, MPI_BYTE, MPI_ANY_SOURCE, MPI_MSG_FTERM,
-						MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-			}
-		}
-
-		printf("FTERM... ");
-
-		has_received = 1;
-		while (has_received) {
-			has_received = 0;
-			MPI_Iprobe(MPI_ANY_SOURCE, MPI_MSG_INCM, MPI_COMM_WORLD, &has_received,
-					MPI_STATUS_IGNORE);
-			if (has_received) {
-				MPI_Recv(dummy, 1, MPI_INT, MPI_ANY_SOURCE, MPI_MSG_INCM,
-						MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-			}
-		}
-		printf("INCM... ");
-
-		has_received = 1;
-		while (has_received) {
-			has_received = 0;
-			MPI_Iprobe(MPI_ANY_SOURCE, MPI_MSG_NODE, MPI_COMM_WORLD, &has_received,
-					&status);
-			if (has_received) {
-				int source = status.MPI_SOURCE;
-				int d_size;
-				MPI_Get_count(&status, MPI_BYTE, &d_size); // TODO: = node_size?
-				MPI_Recv(dummy, d_size, MPI_BYTE, source, MPI_MSG_NODE,
-						MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-			}
-		}
-		printf("NODE... ");
-
-		has_received = 1;
-		while (has_received) {
-			has_received = 0;
-			MPI_Iprobe(MPI_ANY_SOURCE, MPI_MSG_TERM, MPI_COMM_WORLD, &has_received,
-					MPI_STATUS_IGNORE);
-			if (has_received) {
-				MPI_Recv(dummy, 1, MPI_INT, MPI_ANY_SOURCE, MPI_MSG_TERM,
-						MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-			}
-		}
-		printf("TERM... ");
-
-
-
+		transport->shutdown();
 		printf("done!\n");
-		printf("Buffer_detach %d\n", id);
-
-		int buffer_size;
-		MPI_Buffer_detach(&mpi_buffer, &buffer_size);
-	//
-		delete[] mpi_buffer;
 
 		printf("finalize %d\n", id);
 
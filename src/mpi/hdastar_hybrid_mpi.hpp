@@ -0,0 +1,534 @@
+/*
+ * hdastar_hybrid_mpi.hpp
+ *
+ * Hybrid MPI + threads HDA*. One rank per host (or socket) runs tnum
+ * HDA* worker threads, and its main thread does all the MPI calls
+ * (MPI_THREAD_FUNNELED). A state is owned by rank zbr % ranks and, on
+ * that rank, by thread (zbr / ranks) % tnum. Nodes for a thread of the
+ * same rank are handed over as pointers through its income buffer, as
+ * in HDAstar. A node for another rank is encoded by the thread that
+ * generated it into the outbox of that rank, which the main thread sends
+ * as is; the main thread hands the bytes received to the inbox of their
+ * thread, which decodes them. So the main thread allocates no node and
+ * every node is freed into the Pool of its thread.
+ *
+ * The main thread keeps one pair of MPI_Iallreduce in flight, a sum of
+ * (nodes sent, nodes received, busy, stop) over the ranks and a min of
+ * the incumbent. A rank is busy unless all its threads are idle and no
+ * node is in its buffers. The search ends once two waves in a row find
+ * no rank busy and the same number of nodes sent and received (the
+ * four-counter method), or once a rank is out of time.
+ *
+ * The nodes carry no parent, so only the solution cost is found (as
+ * HDAstarCombMPI). Test on one host with e.g.
+ *   mpirun -np 2 --oversubscribe ./mpi_bench hybrid instances 1 2
+ * (make check_hybrid).
+ */
+
+#ifndef HDASTAR_HYBRID_MPI_HPP_
+#define HDASTAR_HYBRID_MPI_HPP_
+
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <mpi.h>
+
+#include "../search.hpp"
+#include "../utils.hpp"
+#include "../fatal.hpp"
+#include "../hashtbl.hpp"
+#include "../heap.hpp"
+#include "../pool.hpp"
+#include "../buffer.hpp"
+
+template<class D> class HDAstarHybridMPI: public SearchAlg<D> {
+
+	enum {
+		TAG_NODE = 0,
+	};
+
+	struct Node {
+		unsigned int f, g;
+		unsigned int zbr;
+		char pop;
+		int openind;
+		typename D::PackedState packed;
+		HashEntry<Node> hentry;
+
+		bool pred(Node *o) {
+			if (f == o->f)
+				return g > o->g;
+			return f < o->f;
+		}
+
+		void setindex(int i) {
+		}
+
+		const typename D::PackedState &key() {
+			return packed;
+		}
+
+		HashEntry<Node> &hashentry() {
+			return hentry;
+		}
+	};
+
+	// A node is sent as f, g, zbr (32 bits each), pop and the packed state.
+	static const unsigned int HEADER_BYTES = 13;
+
+	// Mailbox holds encoded nodes on their way between a thread and the
+	// main thread.
+	struct Mailbox {
+		Mailbox() {
+			pthread_mutex_init(&m, NULL);
+		}
+
+		~Mailbox() {
+			pthread_mutex_destroy(&m);
+		}
+
+		pthread_mutex_t m;
+		std::vector<unsigned char> data;
+	};
+
+	// Send holds a message until its MPI_Isend completes.
+	struct Send {
+		MPI_Request req;
+		std::vector<unsigned char> data;
+	};
+
+	int tnum;
+	int rank, ranks;
+	unsigned int closedlistsize, openlistsize;
+	unsigned int initmaxcost;
+	unsigned int rec; // bytes of an encoded node
+
+	std::atomic<int> thread_id;
+	std::atomic<int> incumbent;
+	std::atomic<bool> done;
+
+	buffer<Node>* income_buffer; // per thread
+	Mailbox* inbox; // per thread, from other ranks
+	Mailbox* outbox; // per rank, sent by the main thread
+	std::atomic<bool>* idle;
+	std::atomic<unsigned long> sent_nodes; // put into buffers and mailboxes
+	std::atomic<unsigned long> received_nodes; // taken from them
+
+	unsigned long remote_sent, remote_received, messages;
+
+	std::vector<unsigned long> expd_distribution;
+	std::vector<unsigned long> gend_distribution;
+	std::vector<unsigned long> duplicates;
+
+	double init_time;
+
+	std::vector<typename D::State> path;
+
+public:
+
+	HDAstarHybridMPI(D &d, int tnum, unsigned int closedlistsize = 1105036,
+			unsigned int openlistsize = 100, unsigned int maxcost = 1000000) :
+			SearchAlg<D>(d), tnum(tnum), rank(0), ranks(1), closedlistsize(
+					closedlistsize), openlistsize(openlistsize), initmaxcost(
+					maxcost), rec(HEADER_BYTES
+					+ typename D::PackedState().byteSize()), thread_id(0), incumbent(
+					maxcost), done(false), remote_sent(0), remote_received(0), messages(
+					0), init_time(0) {
+		income_buffer = new buffer<Node> [tnum];
+		inbox = new Mailbox[tnum];
+		idle = new std::atomic<bool>[tnum];
+		outbox = 0;
+		expd_distribution.resize(tnum);
+		gend_distribution.resize(tnum);
+		duplicates.resize(tnum);
+	}
+
+	~HDAstarHybridMPI() {
+		delete[] income_buffer;
+		delete[] inbox;
+		delete[] idle;
+		delete[] outbox;
+	}
+
+	// search must be called on every rank from the thread that
+	// initialized MPI with at least MPI_THREAD_FUNNELED.
+	std::vector<typename D::State> search(typename D::State &init) {
+		int provided, main;
+		MPI_Query_thread(&provided);
+		MPI_Is_thread_main(&main);
+		if (provided < MPI_THREAD_FUNNELED || !main)
+			throw Fatal("HDAstarHybridMPI: needs MPI_THREAD_FUNNELED");
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+		MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+		delete[] outbox;
+		outbox = new Mailbox[ranks];
+		for (int i = 0; i < tnum; ++i)
+			idle[i] = false;
+		sent_nodes = 0;
+		received_nodes = 0;
+
+		typename D::State s = init;
+		unsigned int zbr = this->dom.dist_hash(s);
+		if (owner_rank(zbr) == rank) {
+			Node n;
+			n.g = 0;
+			n.f = this->dom.h(s);
+			n.pop = -1;
+			n.zbr = zbr;
+			this->dom.pack(n.packed, s);
+			encode(&n, inbox[owner_thread(zbr)].data);
+			sent_nodes = 1;
+		}
+
+		MPI_Barrier(MPI_COMM_WORLD);
+		init_time = walltime();
+		std::vector<pthread_t> t(tnum);
+		for (int i = 0; i < tnum; ++i)
+			pthread_create(&t[i], NULL, &HDAstarHybridMPI::thread_helper, this);
+		communicate();
+		for (int i = 0; i < tnum; ++i)
+			pthread_join(t[i], NULL);
+		this->wtime = walltime();
+		this->ctime = cputime();
+
+		unsigned long local[3] = { 0, 0, 0 }, total[3];
+		for (int i = 0; i < tnum; ++i) {
+			local[0] += expd_distribution[i];
+			local[1] += gend_distribution[i];
+			local[2] += duplicates[i];
+		}
+		MPI_Allreduce(local, total, 3, MPI_UNSIGNED_LONG, MPI_SUM,
+				MPI_COMM_WORLD);
+		this->expd = total[0];
+		this->gend = total[1];
+		this->dup = total[2];
+		unsigned long comm[2] = { remote_sent, messages }, comm_total[2];
+		MPI_Reduce(comm, comm_total, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0,
+				MPI_COMM_WORLD);
+
+		if (rank == 0) {
+			dfpair(stdout, "ranks", "%d", ranks);
+			dfpair(stdout, "threads per rank", "%d", tnum);
+			dfpair(stdout, "solution cost", "%d",
+					incumbent == (int) initmaxcost ? -1 : incumbent.load());
+			dfpair(stdout, "nodes sent between ranks", "%lu", comm_total[0]);
+			dfpair(stdout, "MPI node messages", "%lu", comm_total[1]);
+		}
+		return path;
+	}
+
+	int cost() const {
+		return incumbent == (int) initmaxcost ? -1 : incumbent.load();
+	}
+
+private:
+
+	int owner_rank(unsigned int zbr) const {
+		return zbr % ranks;
+	}
+
+	int owner_thread(unsigned int zbr) const {
+		return (zbr / ranks) % tnum;
+	}
+
+	static void* thread_helper(void* arg) {
+		static_cast<HDAstarHybridMPI*>(arg)->thread_search();
+		return 0;
+	}
+
+	void thread_search() {
+		int id = thread_id.fetch_add(1);
+		HashTable<typename D::PackedState, Node> closed(closedlistsize);
+		Pool<Node> nodes(2048);
+		Heap<Node> open(openlistsize);
+		// Outgo buffers of the threads of this rank and encoded nodes for
+		// the other ranks.
+		std::vector<std::vector<Node*> > outgo_buffer(tnum);
+		std::vector<std::vector<unsigned char> > remote(ranks);
+		std::vector<Node*> tmp;
+		std::vector<unsigned char> bytes;
+		unsigned long expd = 0, gend = 0, dup = 0;
+
+		while (!done) {
+			if (!inbox[id].data.empty()
+					&& pthread_mutex_trylock(&inbox[id].m) == 0) {
+				idle[id] = false;
+				bytes.swap(inbox[id].data);
+				received_nodes += bytes.size() / rec;
+				pthread_mutex_unlock(&inbox[id].m);
+				for (unsigned int at = 0; at < bytes.size(); at += rec) {
+					Node *n = nodes.construct();
+					decode(&bytes[at], n);
+					open.push(n);
+				}
+				bytes.clear();
+			}
+			if (!income_buffer[id].isempty()) {
+				idle[id] = false;
+				if (income_buffer[id].try_lock()) {
+					tmp = income_buffer[id].pull_all_with_lock();
+					received_nodes += tmp.size();
+					income_buffer[id].release_lock();
+					for (unsigned int i = 0; i < tmp.size(); ++i)
+						open.push(tmp[i]);
+					tmp.clear();
+				}
+			}
+
+			if (open.isemptyunder(incumbent.load())) {
+				// Idle only once the outgo buffers are delivered.
+				idle[id] = flush(id, outgo_buffer, remote, 0);
+				continue;
+			}
+
+			Node *n = open.pop();
+			if (n->f >= (unsigned int) incumbent.load()) {
+				nodes.destruct(n);
+				continue;
+			}
+			Node *d = closed.find(n->packed);
+			if (d && d->g <= n->g) {
+				nodes.destruct(n);
+				++dup;
+				continue;
+			}
+
+			typename D::State state;
+			this->dom.unpack(state, n->packed);
+			if (this->dom.isgoal(state)) {
+				int inc = incumbent.load();
+				while ((int) n->g < inc
+						&& !incumbent.compare_exchange_weak(inc, n->g))
+					;
+				nodes.destruct(n);
+				continue;
+			}
+			closed.add(n);
+			++expd;
+
+			int nops = this->dom.nops(state);
+			for (int i = 0; i < nops; ++i) {
+				int op = this->dom.nthop(state, i);
+				if (op == n->pop)
+					continue;
+				++gend;
+				Edge<D> e = this->dom.apply(state, op);
+				Node *next = nodes.construct();
+				next->g = n->g + e.cost;
+				next->f = next->g + this->dom.h(state);
+				next->pop = e.pop;
+				next->zbr = this->dom.dist_hash(state);
+				this->dom.pack(next->packed, state);
+				this->dom.undo(state, e);
+
+				int r = owner_rank(next->zbr);
+				if (r != rank) {
+					encode(next, remote[r]);
+					nodes.destruct(next);
+				} else if (owner_thread(next->zbr) == id) {
+					open.push(next);
+				} else {
+					outgo_buffer[owner_thread(next->zbr)].push_back(next);
+				}
+			}
+			flush(id, outgo_buffer, remote, 32);
+		}
+
+		expd_distribution[id] = expd;
+		gend_distribution[id] = gend;
+		duplicates[id] = dup;
+	}
+
+	// flush delivers the outgo buffers and encoded nodes holding at least
+	// least nodes whose income buffer or outbox is free. Returns true if
+	// all are empty.
+	bool flush(int id, std::vector<std::vector<Node*> > &outgo_buffer,
+			std::vector<std::vector<unsigned char> > &remote,
+			unsigned int least) {
+		bool delivered = true;
+		for (int i = 0; i < tnum; ++i) {
+			if (i == id || outgo_buffer[i].empty())
+				continue;
+			buffer<Node> &b = income_buffer[i];
+			if (outgo_buffer[i].size() >= least && b.try_lock()) {
+				sent_nodes += outgo_buffer[i].size();
+				b.push_all_with_lock(outgo_buffer[i]);
+				b.release_lock();
+				outgo_buffer[i].clear();
+			} else {
+				delivered = false;
+			}
+		}
+		for (int r = 0; r < ranks; ++r) {
+			if (remote[r].empty())
+				continue;
+			if (remote[r].size() >= least * rec
+					&& pthread_mutex_trylock(&outbox[r].m) == 0) {
+				sent_nodes += remote[r].size() / rec;
+				outbox[r].data.insert(outbox[r].data.end(), remote[r].begin(),
+						remote[r].end());
+				pthread_mutex_unlock(&outbox[r].m);
+				remote[r].clear();
+			} else {
+				delivered = false;
+			}
+		}
+		return delivered;
+	}
+
+	// encode appends n to out: f, g, zbr, pop and the packed state.
+	void encode(Node *n, std::vector<unsigned char> &out) {
+		out.resize(out.size() + rec);
+		unsigned char *p = &out[out.size() - rec];
+		memcpy(p, &n->f, 4);
+		memcpy(p + 4, &n->g, 4);
+		memcpy(p + 8, &n->zbr, 4);
+		p[12] = n->pop;
+		n->packed.stateToChars(p + HEADER_BYTES);
+	}
+
+	void decode(unsigned char *p, Node *n) {
+		memcpy(&n->f, p, 4);
+		memcpy(&n->g, p + 4, 4);
+		memcpy(&n->zbr, p + 8, 4);
+		n->pop = p[12];
+		n->packed.charsToState(p + HEADER_BYTES);
+	}
+
+	// communicate is the loop of the main thread: it sends the outboxes,
+	// hands the nodes received to their threads and runs the termination
+	// waves, until the search is over on every rank.
+	void communicate() {
+		std::vector<Send*> sends;
+		std::vector<unsigned char> recv;
+		std::vector<std::vector<unsigned char> > handoff(tnum);
+
+		MPI_Request wave[2];
+		bool in_wave = false;
+		long long sums[4], total[4], last = -1;
+		int inc, min_inc;
+		bool stop = false;
+
+		while (!done) {
+			bool worked = false;
+
+			// Outboxes.
+			for (int r = 0; r < ranks; ++r) {
+				if (r == rank || outbox[r].data.empty()
+						|| pthread_mutex_trylock(&outbox[r].m) != 0)
+					continue;
+				Send *s = new Send;
+				s->data.swap(outbox[r].data);
+				pthread_mutex_unlock(&outbox[r].m);
+				unsigned int out = s->data.size() / rec;
+				received_nodes += out;
+				MPI_Isend(s->data.data(), s->data.size(), MPI_BYTE, r, TAG_NODE,
+						MPI_COMM_WORLD, &s->req);
+				sends.push_back(s);
+				remote_sent += out;
+				++messages;
+				worked = true;
+			}
+			for (unsigned int i = 0; i < sends.size();) {
+				int flag;
+				MPI_Test(&sends[i]->req, &flag, MPI_STATUS_IGNORE);
+				if (flag) {
+					delete sends[i];
+					sends[i] = sends.back();
+					sends.pop_back();
+				} else {
+					++i;
+				}
+			}
+
+			// Nodes from other ranks.
+			int flag;
+			MPI_Status status;
+			MPI_Iprobe(MPI_ANY_SOURCE, TAG_NODE, MPI_COMM_WORLD, &flag,
+					&status);
+			while (flag) {
+				int size;
+				MPI_Get_count(&status, MPI_BYTE, &size);
+				recv.resize(size);
+				MPI_Recv(recv.data(), size, MPI_BYTE, status.MPI_SOURCE,
+						TAG_NODE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+				for (unsigned int at = 0; at + rec <= (unsigned int) size; at +=
+						rec) {
+					unsigned int zbr;
+					memcpy(&zbr, &recv[at + 8], 4);
+					std::vector<unsigned char> &h = handoff[owner_thread(zbr)];
+					h.insert(h.end(), &recv[at], &recv[at] + rec);
+				}
+				remote_received += size / rec;
+				for (int i = 0; i < tnum; ++i) {
+					if (handoff[i].empty())
+						continue;
+					pthread_mutex_lock(&inbox[i].m);
+					sent_nodes += handoff[i].size() / rec;
+					inbox[i].data.insert(inbox[i].data.end(), handoff[i].begin(),
+							handoff[i].end());
+					pthread_mutex_unlock(&inbox[i].m);
+					handoff[i].clear();
+				}
+				worked = true;
+				MPI_Iprobe(MPI_ANY_SOURCE, TAG_NODE, MPI_COMM_WORLD, &flag,
+						&status);
+			}
+
+			// Termination and incumbent waves.
+			if (!in_wave) {
+				if (this->isTimed && walltime() - init_time > this->timer)
+					stop = true;
+				sums[0] = remote_sent;
+				sums[1] = remote_received;
+				sums[2] = !rank_idle();
+				sums[3] = stop;
+				inc = incumbent.load();
+				MPI_Iallreduce(sums, total, 4, MPI_LONG_LONG, MPI_SUM,
+						MPI_COMM_WORLD, &wave[0]);
+				MPI_Iallreduce(&inc, &min_inc, 1, MPI_INT, MPI_MIN,
+						MPI_COMM_WORLD, &wave[1]);
+				in_wave = true;
+			} else {
+				int complete;
+				MPI_Testall(2, wave, &complete, MPI_STATUSES_IGNORE);
+				if (complete) {
+					in_wave = false;
+					int i = incumbent.load();
+					while (min_inc < i
+							&& !incumbent.compare_exchange_weak(i, min_inc))
+						;
+					bool quiet = total[2] == 0 && total[0] == total[1];
+					if (total[3] > 0 || (quiet && total[0] == last))
+						done = true;
+					last = quiet ? total[0] : -1;
+				}
+			}
+
+			if (!worked)
+				sched_yield();
+		}
+		if (!sends.empty()) {
+			for (unsigned int i = 0; i < sends.size(); ++i) {
+				MPI_Wait(&sends[i]->req, MPI_STATUS_IGNORE);
+				delete sends[i];
+			}
+		}
+	}
+
+	// rank_idle returns true if every thread is idle and no node is in
+	// the income buffers or outboxes. received_nodes is read before the
+	// flags and sent_nodes after them (see HDAstar::hasterminated).
+	bool rank_idle() {
+		unsigned long received = received_nodes.load();
+		for (int i = 0; i < tnum; ++i) {
+			if (!idle[i])
+				return false;
+		}
+		return sent_nodes.load() == received;
+	}
+};
+
+#endif /* HDASTAR_HYBRID_MPI_HPP_ */
@@ -0,0 +1,192 @@
+/*
+ * mpi_transport.hpp
+ *
+ * MPITransport sends and receives messages of one tag with bounded
+ * memory. Each destination has a ring of send_slots preallocated slots
+ * of slot_bytes; a slot is reused once its MPI_Isend has completed, and
+ * acquire returns 0 while the ring is full, so the caller keeps its
+ * data until then. recv_slots persistent receives (MPI_Recv_init) are
+ * kept posted for any source, so a message is received without
+ * Iprobe + Get_count + Recv. A message is at most slot_bytes.
+ *
+ * Transport is the interface it shares with RMATransport
+ * (rma_transport.hpp), so a search can switch between them at run time.
+ */
+
+#ifndef MPI_TRANSPORT_HPP_
+#define MPI_TRANSPORT_HPP_
+
+#include <vector>
+#include <mpi.h>
+
+class Transport {
+public:
+
+	Transport() :
+			sent(0), sent_bytes(0), received(0), full(0), polls(0) {
+	}
+
+	virtual ~Transport() {
+	}
+
+	// start allocates the buffers. Collective.
+	virtual void start() = 0;
+
+	// slot_bytes is the largest message.
+	virtual unsigned int slot_bytes() const = 0;
+
+	// acquire returns a buffer for a message to dest, or 0 if there is
+	// no room for one yet.
+	virtual unsigned char* acquire(int dest) = 0;
+
+	// post sends the first bytes of the buffer acquire returned.
+	virtual void post(int dest, unsigned int bytes) = 0;
+
+	// poll returns true with a message received. Its buffer is reused
+	// after release, which must be called before the next poll.
+	virtual bool poll(unsigned char*& data, int& bytes, int* source = 0) = 0;
+	virtual void release() = 0;
+
+	// shutdown is called by every rank once the search is over.
+	virtual void shutdown() = 0;
+
+	// messages and bytes sent, messages received, the times there was
+	// no room for a message and the calls to poll.
+	unsigned long sent, sent_bytes, received, full, polls;
+};
+
+class MPITransport: public Transport {
+public:
+
+	// recv_slots of 0 is two per rank.
+	MPITransport(int tag, unsigned int slot_bytes = 1 << 16,
+			unsigned int send_slots = 4, unsigned int recv_slots = 0) :
+			tag(tag), slot_size(
+					slot_bytes), send_slots(send_slots), recv_slots(recv_slots), ranks(
+					0), current(-1) {
+	}
+
+	~MPITransport() {
+		for (unsigned int i = 0; i < recv_req.size(); ++i) {
+			if (recv_req[i] != MPI_REQUEST_NULL)
+				MPI_Request_free(&recv_req[i]);
+		}
+	}
+
+	// start allocates the slots and posts the receives.
+	virtual void start() {
+		MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+		if (recv_slots == 0)
+			recv_slots = 2 * ranks;
+		send_buf.resize((size_t) ranks * send_slots * slot_size);
+		send_req.assign(ranks * send_slots, MPI_REQUEST_NULL);
+		head.assign(ranks, 0);
+		recv_buf.resize((size_t) recv_slots * slot_size);
+		recv_req.resize(recv_slots);
+		for (unsigned int i = 0; i < recv_slots; ++i) {
+			MPI_Recv_init(&recv_buf[(size_t) i * slot_size], slot_size,
+					MPI_BYTE, MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, &recv_req[i]);
+			MPI_Start(&recv_req[i]);
+		}
+	}
+
+	virtual unsigned int slot_bytes() const {
+		return slot_size;
+	}
+
+	// acquire returns the next send slot to dest, or 0 if it is still
+	// being sent.
+	virtual unsigned char* acquire(int dest) {
+		MPI_Request &req = send_req[dest * send_slots + head[dest]];
+		if (req != MPI_REQUEST_NULL) {
+			int flag;
+			MPI_Test(&req, &flag, MPI_STATUS_IGNORE);
+			if (!flag) {
+				++full;
+				return 0;
+			}
+		}
+		return slot(dest, head[dest]);
+	}
+
+	// post sends the first bytes of the slot acquire returned.
+	virtual void post(int dest, unsigned int bytes) {
+		unsigned int s = head[dest];
+		MPI_Isend(slot(dest, s), bytes, MPI_BYTE, dest, tag, MPI_COMM_WORLD,
+				&send_req[dest * send_slots + s]);
+		head[dest] = (s + 1) % send_slots;
+		++sent;
+		sent_bytes += bytes;
+	}
+
+	// poll returns true with a message received. Its slot is reposted by
+	// release, which must be called before the next poll.
+	virtual bool poll(unsigned char*& data, int& bytes, int* source = 0) {
+		int index, flag;
+		MPI_Status status;
+		++polls;
+		MPI_Testany(recv_slots, &recv_req[0], &index, &flag, &status);
+		if (!flag || index == MPI_UNDEFINED)
+			return false;
+		MPI_Get_count(&status, MPI_BYTE, &bytes);
+		if (source)
+			*source = status.MPI_SOURCE;
+		data = &recv_buf[(size_t) index * slot_size];
+		current = index;
+		++received;
+		return true;
+	}
+
+	virtual void release() {
+		MPI_Start(&recv_req[current]);
+		current = -1;
+	}
+
+	// shutdown is called by every rank once the search is over. It waits
+	// for its sends, discarding what it receives, until every rank is done
+	// sending, and then cancels the receives.
+	virtual void shutdown() {
+		MPI_Request barrier;
+		bool in_barrier = false;
+		while (true) {
+			unsigned char* data;
+			int bytes;
+			while (poll(data, bytes))
+				release();
+			int flag;
+			if (!in_barrier) {
+				MPI_Testall(send_req.size(), &send_req[0], &flag,
+						MPI_STATUSES_IGNORE);
+				if (flag) {
+					MPI_Ibarrier(MPI_COMM_WORLD, &barrier);
+					in_barrier = true;
+				}
+			} else {
+				MPI_Test(&barrier, &flag, MPI_STATUS_IGNORE);
+				if (flag)
+					break;
+			}
+		}
+		for (unsigned int i = 0; i < recv_slots; ++i) {
+			MPI_Cancel(&recv_req[i]);
+			MPI_Wait(&recv_req[i], MPI_STATUS_IGNORE);
+			MPI_Request_free(&recv_req[i]);
+		}
+	}
+
+private:
+
+	unsigned char* slot(int dest, unsigned int s) {
+		return &send_buf[((size_t) dest * send_slots + s) * slot_size];
+	}
+
+	int tag;
+	unsigned int slot_size, send_slots, recv_slots;
+	int ranks;
+	std::vector<unsigned char> send_buf, recv_buf;
+	std::vector<MPI_Request> send_req, recv_req;
+	std::vector<unsigned int> head; // next slot to each destination
+	int current; // slot of the message being handled
+};
+
+#endif /* MPI_TRANSPORT_HPP_ */
@@ -0,0 +1,187 @@
+/*
+ * rma_transport.hpp
+ *
+ * RMATransport sends messages with one-sided MPI. Every rank exposes an
+ * income window (MPI_Win_allocate) with a ring of slots of slot_bytes
+ * for each source, the tail (slots written) and the head (slots read)
+ * of each ring. A sender MPI_Puts a message, its size first, into the
+ * next slot of its ring at dest, flushes it and bumps the tail with
+ * MPI_Fetch_and_op. The receiver reads all its tails at once and reads
+ * the messages in place, with no matching, then advances the head. A
+ * sender rereads the head only when its ring looks full.
+ *
+ * Passive target (MPI_Win_lock_all) for the whole search. With the
+ * unified memory model the receiver loads its tails and stores its heads
+ * directly, after MPI_Win_sync.
+ */
+
+#ifndef RMA_TRANSPORT_HPP_
+#define RMA_TRANSPORT_HPP_
+
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <mpi.h>
+
+#include "mpi_transport.hpp"
+
+class RMATransport: public Transport {
+public:
+
+	RMATransport(unsigned int slot_bytes = 1 << 16, unsigned int slots = 4) :
+			slot_size(slot_bytes), slots(slots), ranks(0), rank(0), base(0), win(
+					MPI_WIN_NULL), unified(false), current(-1), next_source(0) {
+	}
+
+	~RMATransport() {
+		if (win != MPI_WIN_NULL) {
+			MPI_Win_unlock_all(win);
+			MPI_Win_free(&win);
+		}
+	}
+
+	virtual void start() {
+		MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+		MPI_Aint size = 2 * ranks * sizeof(int64_t)
+				+ (MPI_Aint) ranks * slots * slot_size;
+		MPI_Win_allocate(size, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &base, &win);
+		memset(base, 0, 2 * ranks * sizeof(int64_t));
+		int* model;
+		int flag;
+		MPI_Win_get_attr(win, MPI_WIN_MODEL, &model, &flag);
+		unified = flag && *model == MPI_WIN_UNIFIED;
+		MPI_Barrier(MPI_COMM_WORLD);
+		MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+
+		staging.resize(slot_size);
+		tail.assign(ranks, 0);
+		head.assign(ranks, 0);
+		tails.assign(ranks, 0);
+		read.assign(ranks, 0);
+	}
+
+	// The size of a message takes the first 4 bytes of its slot.
+	virtual unsigned int slot_bytes() const {
+		return slot_size - 4;
+	}
+
+	virtual unsigned char* acquire(int dest) {
+		if (tail[dest] - head[dest] >= (int64_t) slots) {
+			MPI_Fetch_and_op(0, &head[dest], MPI_INT64_T, dest,
+					head_disp(rank), MPI_NO_OP, win);
+			MPI_Win_flush(dest, win);
+			if (tail[dest] - head[dest] >= (int64_t) slots) {
+				++full;
+				return 0;
+			}
+		}
+		return &staging[4];
+	}
+
+	virtual void post(int dest, unsigned int bytes) {
+		uint32_t size = bytes;
+		memcpy(&staging[0], &size, 4);
+		MPI_Put(&staging[0], 4 + bytes, MPI_BYTE, dest,
+				slot_disp(rank, tail[dest] % slots), 4 + bytes, MPI_BYTE, win);
+		MPI_Win_flush(dest, win);
+		int64_t one = 1, old;
+		MPI_Fetch_and_op(&one, &old, MPI_INT64_T, dest, tail_disp(rank),
+				MPI_SUM, win);
+		MPI_Win_flush(dest, win);
+		++tail[dest];
+		++sent;
+		sent_bytes += bytes;
+	}
+
+	virtual bool poll(unsigned char*& data, int& bytes, int* source = 0) {
+		++polls;
+		int s = pending();
+		if (s < 0) {
+			if (unified) {
+				MPI_Win_sync(win);
+				memcpy(&tails[0], base, ranks * sizeof(int64_t));
+			} else {
+				MPI_Get_accumulate(0, 0, MPI_INT64_T, &tails[0], ranks,
+						MPI_INT64_T, rank, 0, ranks, MPI_INT64_T, MPI_NO_OP,
+						win);
+				MPI_Win_flush(rank, win);
+				MPI_Win_sync(win);
+			}
+			s = pending();
+			if (s < 0)
+				return false;
+		}
+		unsigned char* slot = base + slot_disp(s, read[s] % slots);
+		uint32_t size;
+		memcpy(&size, slot, 4);
+		data = slot + 4;
+		bytes = size;
+		if (source)
+			*source = s;
+		current = s;
+		next_source = (s + 1) % ranks;
+		++received;
+		return true;
+	}
+
+	virtual void release() {
+		int64_t h = ++read[current], old;
+		if (unified) {
+			memcpy(base + head_disp(current), &h, sizeof(h));
+			MPI_Win_sync(win);
+		} else {
+			MPI_Fetch_and_op(&h, &old, MPI_INT64_T, rank, head_disp(current),
+					MPI_REPLACE, win);
+			MPI_Win_flush(rank, win);
+		}
+		current = -1;
+	}
+
+	// Every put is complete once posted, so shutdown only frees the
+	// window once every rank is done.
+	virtual void shutdown() {
+		MPI_Win_unlock_all(win);
+		MPI_Win_free(&win);
+		win = MPI_WIN_NULL;
+	}
+
+private:
+
+	// pending returns a source with a message not read yet as of the last
+	// read of the tails, from next_source on, or -1.
+	int pending() const {
+		for (int i = 0; i < ranks; ++i) {
+			int s = (next_source + i) % ranks;
+			if (tails[s] > read[s])
+				return s;
+		}
+		return -1;
+	}
+
+	MPI_Aint tail_disp(int source) const {
+		return source * sizeof(int64_t);
+	}
+
+	MPI_Aint head_disp(int source) const {
+		return (ranks + source) * sizeof(int64_t);
+	}
+
+	MPI_Aint slot_disp(int source, unsigned int s) const {
+		return 2 * ranks * sizeof(int64_t)
+				+ ((MPI_Aint) source * slots + s) * slot_size;
+	}
+
+	unsigned int slot_size, slots;
+	int ranks, rank;
+	unsigned char* base; // the window
+	MPI_Win win;
+	bool unified; // MPI_WIN_UNIFIED
+	std::vector<unsigned char> staging; // the message being written
+	std::vector<int64_t> tail, head; // of the ring at each destination
+	std::vector<int64_t> tails, read; // of the ring of each source here
+	int current; // source of the message being handled
+	int next_source;
+};
+
+#endif /* RMA_TRANSPORT_HPP_ */
@@ -0,0 +1,263 @@
+/*
+ * wire_format.hpp
+ *
+ * WireFormat encodes batches of search nodes for MPI messages. A
+ * message is a format byte and the number of nodes (32 bits), then the
+ * nodes.
+ *
+ * RAW: each node is a WireRecord (f, g, pop and the rank and closed
+ * list index of its parent), copied with memcpy, and the packed state.
+ * A state whose PackedState defines wire_bytes, to_wire and from_wire
+ * (Tiles, Tiles24, SlidingTiles) is copied as is in wire_bytes; any
+ * other (STRIPS) is its varint length and stateToChars. RAW assumes
+ * every rank has the same byte order.
+ *
+ * COMPRESSED: the nodes of a batch are sorted by state and each state
+ * is sent as the number of leading bytes it shares with the previous
+ * one and the rest of its stateToChars (after its varint length if it
+ * is of variable size). g and h = f - g are varints, pop a byte, and the
+ * parent rank + 1 and index varints.
+ */
+
+#ifndef WIRE_FORMAT_HPP_
+#define WIRE_FORMAT_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <type_traits>
+
+// WireRecord is the fixed part of a RAW node.
+struct WireRecord {
+	uint32_t f, g;
+	int8_t pop;
+	int32_t parent_rank;
+	uint32_t parent_index;
+} __attribute__((packed));
+
+template<class P, class = void> struct HasWireBytes: std::false_type {
+};
+template<class P> struct HasWireBytes<P, decltype((void) P::wire_bytes)> : std::true_type {
+};
+
+// StateWire puts and gets a packed state in RAW.
+template<class P, bool Fixed = HasWireBytes<P>::value> struct StateWire {
+	static unsigned int max_bytes(const P &p) {
+		return 5 + p.byteSize();
+	}
+	static unsigned char* put(const P &p, unsigned char* d);
+	static const unsigned char* get(P &p, const unsigned char* d);
+};
+
+template<class P> struct StateWire<P, true> {
+	static unsigned int max_bytes(const P &p) {
+		return P::wire_bytes;
+	}
+	static unsigned char* put(const P &p, unsigned char* d) {
+		p.to_wire(d);
+		return d + P::wire_bytes;
+	}
+	static const unsigned char* get(P &p, const unsigned char* d) {
+		p.from_wire(d);
+		return d + P::wire_bytes;
+	}
+};
+
+inline unsigned char* put_varint(unsigned char* d, uint32_t v) {
+	while (v >= 0x80) {
+		*d++ = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	*d++ = v;
+	return d;
+}
+
+inline const unsigned char* get_varint(const unsigned char* d, uint32_t &v) {
+	v = 0;
+	for (int s = 0;; s += 7) {
+		v |= (uint32_t) (*d & 0x7f) << s;
+		if (!(*d++ & 0x80))
+			return d;
+	}
+}
+
+template<class P, bool Fixed> unsigned char* StateWire<P, Fixed>::put(
+		const P &p, unsigned char* d) {
+	d = put_varint(d, p.byteSize());
+	p.stateToChars(d);
+	return d + p.byteSize();
+}
+
+template<class P, bool Fixed> const unsigned char* StateWire<P, Fixed>::get(
+		P &p, const unsigned char* d) {
+	uint32_t n;
+	d = get_varint(d, n);
+	p.charsToState(const_cast<unsigned char*>(d));
+	return d + n;
+}
+
+// Node needs f, g, pop, parent_rank, parent_index and packed.
+template<class Node> class WireFormat {
+	typedef typename std::remove_reference<decltype(((Node*) 0)->packed)>::type PackedState;
+	static const bool Fixed = HasWireBytes<PackedState>::value;
+
+public:
+	enum Format {
+		RAW = 0, COMPRESSED = 1,
+	};
+	static const unsigned int HEADER_BYTES = 5;
+
+	WireFormat(Format format = RAW) :
+			format(format) {
+	}
+
+	void set_format(Format f) {
+		format = f;
+	}
+
+	// encode writes as many of the n nodes as fit in cap bytes to out.
+	// Returns the number of nodes written and their size in bytes.
+	unsigned int encode(const Node* nodes, unsigned int n, unsigned char* out,
+			unsigned int cap, unsigned int &bytes) {
+		out[0] = format;
+		unsigned char* d = out + HEADER_BYTES;
+		unsigned char* end = out + cap;
+		unsigned int k = 0;
+		if (format == RAW) {
+			for (; k < n; ++k) {
+				const Node &m = nodes[k];
+				if (end - d < (long) (sizeof(WireRecord)
+						+ StateWire<PackedState>::max_bytes(m.packed)))
+					break;
+				WireRecord r;
+				r.f = m.f;
+				r.g = m.g;
+				r.pop = m.pop;
+				r.parent_rank = m.parent_rank;
+				r.parent_index = m.parent_index;
+				memcpy(d, &r, sizeof(r));
+				d = StateWire<PackedState>::put(m.packed, d + sizeof(r));
+			}
+		} else {
+			k = encode_compressed(nodes, n, d, end);
+		}
+		uint32_t count = k;
+		memcpy(out + 1, &count, 4);
+		bytes = d - out;
+		return k;
+	}
+
+	// decode appends the nodes of a message to nodes.
+	void decode(const unsigned char* d, unsigned int size,
+			std::vector<Node*> &nodes) {
+		uint32_t count;
+		memcpy(&count, d + 1, 4);
+		const unsigned char* p = d + HEADER_BYTES;
+		if (d[0] == RAW) {
+			for (uint32_t i = 0; i < count; ++i) {
+				Node* n = new Node();
+				WireRecord r;
+				memcpy(&r, p, sizeof(r));
+				n->f = r.f;
+				n->g = r.g;
+				n->pop = r.pop;
+				n->parent_rank = r.parent_rank;
+				n->parent_index = r.parent_index;
+				p = StateWire<PackedState>::get(n->packed, p + sizeof(r));
+				nodes.push_back(n);
+			}
+			return;
+		}
+		std::vector<unsigned char> prev, cur;
+		for (uint32_t i = 0; i < count; ++i) {
+			Node* n = new Node();
+			uint32_t len, shared, g, h, rank, index;
+			if (Fixed) {
+				len = n->packed.byteSize();
+			} else {
+				p = get_varint(p, len);
+			}
+			shared = *p++;
+			cur.resize(len);
+			std::copy(prev.begin(), prev.begin() + shared, cur.begin());
+			std::copy(p, p + len - shared, cur.begin() + shared);
+			p += len - shared;
+			n->packed.charsToState(&cur[0]);
+			p = get_varint(p, g);
+			p = get_varint(p, h);
+			n->g = g;
+			n->f = g + h;
+			n->pop = (int8_t) *p++;
+			p = get_varint(p, rank);
+			p = get_varint(p, index);
+			n->parent_rank = (int) rank - 1;
+			n->parent_index = index;
+			nodes.push_back(n);
+			prev.swap(cur);
+		}
+	}
+
+private:
+
+	unsigned int encode_compressed(const Node* nodes, unsigned int n,
+			unsigned char* &d, unsigned char* end) {
+		// Take the nodes that fit at their largest size, then sort them.
+		offsets.clear();
+		states.clear();
+		unsigned int k = 0;
+		long room = end - d;
+		for (; k < n; ++k) {
+			unsigned int len = nodes[k].packed.byteSize();
+			room -= 5 + 1 + len + 5 + 5 + 1 + 5 + 5;
+			if (room < 0)
+				break;
+			offsets.push_back(states.size());
+			states.resize(states.size() + len);
+			nodes[k].packed.stateToChars(&states[offsets.back()]);
+		}
+		offsets.push_back(states.size());
+		order.resize(k);
+		for (unsigned int i = 0; i < k; ++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(),
+				[this](unsigned int a, unsigned int b) {
+					return std::lexicographical_compare(
+							states.begin() + offsets[a],
+							states.begin() + offsets[a + 1],
+							states.begin() + offsets[b],
+							states.begin() + offsets[b + 1]);
+				});
+
+		const unsigned char* prev = 0;
+		unsigned int prev_len = 0;
+		for (unsigned int i = 0; i < k; ++i) {
+			unsigned int j = order[i];
+			const unsigned char* s = &states[offsets[j]];
+			unsigned int len = offsets[j + 1] - offsets[j];
+			unsigned int shared = 0;
+			while (prev && shared < len && shared < prev_len && shared < 255
+					&& s[shared] == prev[shared])
+				++shared;
+			if (!Fixed)
+				d = put_varint(d, len);
+			*d++ = shared;
+			memcpy(d, s + shared, len - shared);
+			d += len - shared;
+			d = put_varint(d, nodes[j].g);
+			d = put_varint(d, nodes[j].f - nodes[j].g);
+			*d++ = nodes[j].pop;
+			d = put_varint(d, nodes[j].parent_rank + 1);
+			d = put_varint(d, nodes[j].parent_index);
+			prev = s;
+			prev_len = len;
+		}
+		return k;
+	}
+
+	Format format;
+	std::vector<unsigned char> states; // stateToChars of the batch
+	std::vector<unsigned int> offsets, order;
+};
+
+#endif /* WIRE_FORMAT_HPP_ */
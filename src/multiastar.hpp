@@ -50,13 +50,13 @@ public:
 		this->init = init;
 		pthread_t t[n_threads];
 		for (int i = 0; i < n_threads; ++i) {
-			pthread_create(&t[n_threads], NULL,
+			pthread_create(&t[i], NULL,
 					(void*(*)(void*))&MultiAstar::thread_helper, this);
 		}
 		printf("running\n");
 
 		for (int i = 0; i < n_threads; ++i) {
-			pthread_join(t[n_threads], NULL);
+			pthread_join(t[i], NULL);
 		}
 		printf("ran\n");
 		this->wtime = walltime();
@@ -0,0 +1,255 @@
+/*
+ * multiqueue.hpp
+ *
+ * MultiQueue is a relaxed concurrent open list, a drop-in for
+ * ConcurrentHeap in PPAstar. It has n_queues Heaps, each behind its own
+ * lock, and publishes the top priority of each in an atomic hint on its
+ * own cache line. A pop samples two queues at random, takes the one with
+ * the better hint and, if its lock is taken, samples again instead of
+ * waiting. The more queues per thread, the less contention and the
+ * further a pop may be from the true minimum.
+ *
+ * A push goes to a buffer of the pushing thread, which moves to a random
+ * queue under one lock once it holds buffer_size nodes. A pop takes the
+ * best buffered node without a lock if it is no worse than both sampled
+ * hints, as a child often is in A*.
+ *
+ * The order is that of Heap: f first, then larger g first.
+ */
+
+#ifndef MULTIQUEUE_HPP_
+#define MULTIQUEUE_HPP_
+
+#include <vector>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <pthread.h>
+
+#include "heap.hpp"
+#include "fatal.hpp"
+
+template<class HeapElm> class MultiQueue {
+
+	static const int EMPTY = 2147483647;
+	static const int CACHE_LINE = 64;
+
+	// Read by every popping thread, written under lock.
+	struct Hint {
+		std::atomic<int> top, minf;
+		pthread_mutex_t m;
+	};
+
+	// Touched by its thread only, but minf for isemptyunder.
+	struct Buffer {
+		std::vector<HeapElm*> elms;
+		std::atomic<int> minf;
+		unsigned long rng;
+	};
+
+	// Allocated on cache line boundaries by lines().
+	template<class T> struct Padded: public T {
+		char pad[CACHE_LINE - sizeof(T) % CACHE_LINE];
+	};
+
+	template<class T> static T *lines(unsigned int n) {
+		void *p;
+		if (posix_memalign(&p, CACHE_LINE, n * sizeof(T)) != 0)
+			throw Fatal("MultiQueue: posix_memalign failed");
+		T *t = static_cast<T*>(p);
+		for (unsigned int i = 0; i < n; ++i)
+			new (&t[i]) T();
+		return t;
+	}
+
+	template<class T> static void free_lines(T *t, unsigned int n) {
+		for (unsigned int i = 0; i < n; ++i)
+			t[i].~T();
+		free(t);
+	}
+
+	unsigned int n_queues, n_threads;
+	unsigned int buffer_size;
+	std::vector<Heap<HeapElm> > heaps;
+	Padded<Hint> *hints;
+	Padded<Buffer> *buffers;
+	std::atomic<int> fill;
+
+public:
+
+	// sz is the bound on f. n_queues / n_threads is the relaxation.
+	MultiQueue(unsigned int sz, unsigned int n_queues, unsigned int n_threads,
+			unsigned int buffer_size = 4) :
+			n_queues(n_queues < 2 ? 2 : n_queues), n_threads(n_threads), buffer_size(
+					buffer_size), heaps(this->n_queues, Heap<HeapElm>(sz)), fill(
+					0) {
+		hints = lines<Padded<Hint> >(this->n_queues);
+		for (unsigned int i = 0; i < this->n_queues; ++i) {
+			hints[i].top = EMPTY;
+			hints[i].minf = EMPTY;
+			pthread_mutex_init(&hints[i].m, NULL);
+		}
+		// One more for pushes from outside the search threads.
+		buffers = lines<Padded<Buffer> >(n_threads + 1);
+		for (unsigned int i = 0; i <= n_threads; ++i) {
+			buffers[i].elms.reserve(buffer_size);
+			buffers[i].minf = EMPTY;
+			buffers[i].rng = 0x9E3779B97F4A7C15UL * (i + 1);
+		}
+	}
+
+	~MultiQueue() {
+		for (unsigned int i = 0; i < n_queues; ++i)
+			pthread_mutex_destroy(&hints[i].m);
+		free_lines(hints, n_queues);
+		free_lines(buffers, n_threads + 1);
+	}
+
+	static const char *kind(void) {
+		return "multiqueue";
+	}
+
+	void push(HeapElm *n, unsigned int thread_id = -1) {
+		Buffer &b = buffer(thread_id);
+		b.elms.push_back(n);
+		if (n->f < b.minf.load(std::memory_order_relaxed))
+			b.minf.store(n->f, std::memory_order_relaxed);
+		++fill;
+		if (b.elms.size() >= buffer_size || thread_id >= n_threads)
+			flush(b); // nobody pops the buffer of outside pushes
+	}
+
+	HeapElm *pop(unsigned int thread_id) {
+		Buffer &b = buffer(thread_id);
+		int best = b.elms.empty() ? EMPTY : bestbuffered(b);
+		for (int tries = 0;; ++tries) {
+			unsigned int i = random(b) % n_queues;
+			unsigned int j = random(b) % (n_queues - 1);
+			if (j >= i)
+				++j;
+			int ti = hints[i].top.load(std::memory_order_relaxed);
+			int tj = hints[j].top.load(std::memory_order_relaxed);
+			if (tj < ti) {
+				i = j;
+				ti = tj;
+			}
+			if (best != EMPTY && priority(b.elms[best]) <= ti)
+				return popbuffered(b, best);
+			if (ti == EMPTY) {
+				if (tries < 4)
+					continue;
+				if (best != EMPTY)
+					return popbuffered(b, best);
+				return NULL;
+			}
+			if (pthread_mutex_trylock(&hints[i].m) != 0)
+				continue;
+			HeapElm *n = NULL;
+			if (!heaps[i].isempty()) {
+				n = heaps[i].pop();
+				--fill;
+			}
+			publish(i);
+			pthread_mutex_unlock(&hints[i].m);
+			if (n)
+				return n;
+		}
+	}
+
+	// isemptyunder is true if no node, queued or buffered, has f below
+	// incumbent - 1 (see Heap::isemptyunder).
+	bool isemptyunder(int incumbent) {
+		return fill == 0 || minf() >= incumbent - 1;
+	}
+
+	bool isempty(void) {
+		return fill == 0;
+	}
+
+	int minf() {
+		int m = EMPTY;
+		for (unsigned int i = 0; i < n_queues; ++i) {
+			int f = hints[i].minf.load(std::memory_order_relaxed);
+			if (f < m)
+				m = f;
+		}
+		for (unsigned int i = 0; i <= n_threads; ++i) {
+			int f = buffers[i].minf.load(std::memory_order_relaxed);
+			if (f < m)
+				m = f;
+		}
+		return m;
+	}
+
+	int getsize() {
+		return fill;
+	}
+
+	bool mem(HeapElm *n) {
+		return n->openind >= 0;
+	}
+
+private:
+
+	static int priority(HeapElm *n) {
+		return n->f * 100000 - n->g;
+	}
+
+	Buffer &buffer(unsigned int thread_id) {
+		return buffers[thread_id < n_threads ? thread_id : n_threads];
+	}
+
+	static unsigned long random(Buffer &b) {
+		b.rng ^= b.rng << 13;
+		b.rng ^= b.rng >> 7;
+		b.rng ^= b.rng << 17;
+		return b.rng >> 16;
+	}
+
+	// publish updates the hint of queue i, whose lock is held.
+	void publish(unsigned int i) {
+		if (heaps[i].isempty()) {
+			hints[i].top.store(EMPTY, std::memory_order_relaxed);
+			hints[i].minf.store(EMPTY, std::memory_order_relaxed);
+		} else {
+			hints[i].top.store(heaps[i].getpriority(), std::memory_order_relaxed);
+			hints[i].minf.store(heaps[i].minf(), std::memory_order_relaxed);
+		}
+	}
+
+	// flush moves the buffer to the first free queue of a random sequence.
+	void flush(Buffer &b) {
+		unsigned int i = random(b) % n_queues;
+		while (pthread_mutex_trylock(&hints[i].m) != 0)
+			i = random(b) % n_queues;
+		for (unsigned int k = 0; k < b.elms.size(); ++k)
+			heaps[i].push(b.elms[k]);
+		publish(i);
+		pthread_mutex_unlock(&hints[i].m);
+		b.elms.clear();
+		b.minf.store(EMPTY, std::memory_order_relaxed);
+	}
+
+	int bestbuffered(Buffer &b) {
+		int best = 0;
+		for (unsigned int k = 1; k < b.elms.size(); ++k)
+			if (priority(b.elms[k]) < priority(b.elms[best]))
+				best = k;
+		return best;
+	}
+
+	HeapElm *popbuffered(Buffer &b, int k) {
+		HeapElm *n = b.elms[k];
+		b.elms[k] = b.elms.back();
+		b.elms.pop_back();
+		int m = EMPTY;
+		for (unsigned int i = 0; i < b.elms.size(); ++i)
+			if (b.elms[i]->f < m)
+				m = b.elms[i]->f;
+		b.minf.store(m, std::memory_order_relaxed);
+		--fill;
+		return n;
+	}
+};
+
+#endif /* MULTIQUEUE_HPP_ */
@@ -0,0 +1,341 @@
+/*
+ * pase.hpp
+ *
+ * Parallel A* with per-thread open lists and a shared lock-free closed
+ * list that expands at once every node that no other node, open or being
+ * expanded, can improve (in the spirit of PA*SE).
+ *
+ * PA*SE expands s in parallel with every s' of lower f once
+ * g(s) - g(s') <= h(s', s). With only a consistent h to the goal the best
+ * bound on h(s', s) is h(s') - h(s), for which this holds exactly when
+ * f(s) <= f(s'). So all the nodes of the lowest f layer are safe to expand
+ * together and none of higher f is: every node is expanded once, with its
+ * optimal g, and never one with f above the optimal cost, which keeps the
+ * search overhead at that of A* (up to ties on the last layer).
+ *
+ * Instead of one concurrent open list, each thread has open lists by f
+ * and pushes its children to its own; a thread out of nodes of the
+ * current layer steals half of another's. Any node of the layer will do,
+ * so the global order a shared list would keep buys nothing, and the own
+ * lists keep pushes uncontended.
+ * work[f] counts the nodes of f open or being expanded; a child is counted
+ * before its parent is done, so once work[f] of the current layer is 0 it
+ * stays 0 and the layer moves to the next f with work.
+ */
+
+#ifndef PASE_HPP_
+#define PASE_HPP_
+
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+
+#include "search.hpp"
+#include "utils.hpp"
+#include "fatal.hpp"
+#include "pool.hpp"
+#include "lockfree_hashtbl.hpp"
+
+template<class D> class Pase: public SearchAlg<D> {
+
+	struct Node {
+		unsigned int f, g;
+		char pop;
+		Node *parent;
+		typename D::PackedState packed;
+		HashEntry<Node> hentry;
+
+		const typename D::PackedState &key() {
+			return packed;
+		}
+
+		HashEntry<Node> &hashentry() {
+			return hentry;
+		}
+	};
+
+	// Layer holds the open nodes of one f by g, larger g first as in Heap.
+	struct Layer {
+		Layer() :
+				max(0), fill(0) {
+		}
+
+		void push(Node *n) {
+			if (gs.size() <= n->g)
+				gs.resize(n->g + 1);
+			if (n->g > max)
+				max = n->g;
+			gs[n->g].push_back(n);
+			++fill;
+		}
+
+		// bin returns the nodes of the largest g.
+		std::vector<Node*> &bin() {
+			while (gs[max].empty())
+				--max;
+			return gs[max];
+		}
+
+		std::vector<std::vector<Node*> > gs;
+		unsigned int max;
+		unsigned long fill;
+	};
+
+	// Open holds the open nodes of one thread by f.
+	struct Open {
+		std::vector<Layer> fs;
+		pthread_mutex_t m;
+	};
+
+	int tnum;
+	unsigned int maxf;
+	Open* open;
+	std::atomic<long>* work;
+	std::atomic<unsigned int> layer; // the f being expanded
+	std::atomic<unsigned int> top; // the largest f pushed
+	std::atomic<bool> done;
+	std::atomic<int> thread_id;
+
+	LockFreeHashTable<typename D::PackedState, Node> closed;
+	std::vector<Pool<Node>*> pools;
+
+	std::vector<typename D::State> path;
+
+	std::vector<unsigned long> expd_distribution, gend_distribution;
+	std::vector<unsigned long> dups, steals, idles;
+	std::atomic<unsigned long> layers;
+
+public:
+
+	Pase(D &d, int tnum_, unsigned int closedlistsize = 4000037,
+			unsigned int maxf_ = 100000) :
+			SearchAlg<D>(d), tnum(tnum_), maxf(maxf_), layer(0), top(0), done(
+					false), thread_id(0), closed(closedlistsize), layers(0) {
+		open = new Open[tnum];
+		for (int i = 0; i < tnum; ++i) {
+			pthread_mutex_init(&open[i].m, NULL);
+			pools.push_back(new Pool<Node>(2048));
+		}
+		work = new std::atomic<long>[maxf];
+		for (unsigned int i = 0; i < maxf; ++i)
+			work[i] = 0;
+		expd_distribution.resize(tnum);
+		gend_distribution.resize(tnum);
+		dups.resize(tnum);
+		steals.resize(tnum);
+		idles.resize(tnum);
+	}
+
+	~Pase() {
+		for (int i = 0; i < tnum; ++i) {
+			pthread_mutex_destroy(&open[i].m);
+			delete pools[i];
+		}
+		delete[] open;
+		delete[] work;
+	}
+
+	virtual std::vector<typename D::State> search(typename D::State &init) {
+		Node *n = pools[0]->construct();
+		n->g = 0;
+		n->f = this->dom.h(init);
+		n->pop = -1;
+		n->parent = 0;
+		this->dom.pack(n->packed, init);
+		if (n->f >= maxf)
+			throw Fatal("Pase: f = %u is over %u", n->f, maxf);
+		push(0, n);
+		work[n->f] = 1;
+		layer = top = n->f;
+
+		std::vector<pthread_t> t(tnum);
+		for (int i = 0; i < tnum; ++i)
+			pthread_create(&t[i], NULL, &Pase::thread_helper, this);
+		for (int i = 0; i < tnum; ++i)
+			pthread_join(t[i], NULL);
+
+		this->wtime = walltime();
+		this->ctime = cputime();
+
+		unsigned long dup = 0, steal = 0, idle = 0;
+		for (int i = 0; i < tnum; ++i) {
+			this->expd += expd_distribution[i];
+			this->gend += gend_distribution[i];
+			dup += dups[i];
+			steal += steals[i];
+			idle += idles[i];
+		}
+		this->dup = dup;
+		dfpair(stdout, "layers", "%lu", layers.load());
+		dfpair(stdout, "duplicates", "%lu", dup);
+		dfpair(stdout, "steals", "%lu", steal);
+		dfpair(stdout, "idle polls", "%lu", idle);
+		return path;
+	}
+
+private:
+
+	static void* thread_helper(void* arg) {
+		static_cast<Pase*>(arg)->thread_search();
+		return 0;
+	}
+
+	void thread_search() {
+		int id = thread_id.fetch_add(1);
+		Pool<Node> &nodes = *pools[id];
+		std::vector<Node*> kids;
+		typename D::State state;
+
+		while (!done) {
+			unsigned int f = layer;
+			if (work[f] == 0) {
+				advance(f);
+				continue;
+			}
+			Node *n = pop(id, f);
+			if (!n) {
+				++idles[id]; // the rest of the layer is being expanded
+				sched_yield();
+				continue;
+			}
+
+			if (closed.insert(n) != n) {
+				++dups[id];
+				nodes.destruct(n);
+				--work[f];
+				continue;
+			}
+
+			this->dom.unpack(state, n->packed);
+			if (this->dom.isgoal(state)) {
+				if (!done.exchange(true))
+					for (Node *p = n; p; p = p->parent) {
+						typename D::State s;
+						this->dom.unpack(s, p->packed);
+						path.push_back(s);
+					}
+				break;
+			}
+
+			++expd_distribution[id];
+			kids.clear();
+			for (int i = 0; i < this->dom.nops(state); ++i) {
+				int op = this->dom.nthop(state, i);
+				if (op == n->pop)
+					continue;
+				++gend_distribution[id];
+				Edge<D> e = this->dom.apply(state, op);
+				Node *k = wrap(state, n, e.cost, e.pop, nodes);
+				this->dom.undo(state, e);
+				if (closed.find(k->packed)) {
+					++dups[id];
+					nodes.destruct(k);
+					continue;
+				}
+				if (k->f >= maxf)
+					throw Fatal("Pase: f = %u is over %u", k->f, maxf);
+				++work[k->f];
+				unsigned int t = top;
+				while (k->f > t && !top.compare_exchange_weak(t, k->f))
+					;
+				kids.push_back(k);
+			}
+			push(id, kids);
+			--work[f];
+		}
+	}
+
+	// advance moves the layer past f, whose nodes are all expanded, to
+	// the next f with work, or ends the search if there is none. f may
+	// be stale, as the layer may have moved on since it was read and
+	// nodes of it since been expanded; then top and the work seen are
+	// not final and only the current layer can end the search.
+	void advance(unsigned int f) {
+		unsigned int t = top;
+		unsigned int next = f + 1;
+		while (next <= t && work[next] == 0)
+			++next;
+		if (next > t) {
+			if (layer == f)
+				done = true;
+			return;
+		}
+		if (layer.compare_exchange_strong(f, next))
+			++layers;
+	}
+
+	void push(int id, Node *n) {
+		std::vector<Node*> ns(1, n);
+		push(id, ns);
+	}
+
+	void push(int id, std::vector<Node*> &ns) {
+		if (ns.empty())
+			return;
+		Open &o = open[id];
+		pthread_mutex_lock(&o.m);
+		for (unsigned int i = 0; i < ns.size(); ++i) {
+			if (o.fs.size() <= ns[i]->f)
+				o.fs.resize(ns[i]->f + 1);
+			o.fs[ns[i]->f].push(ns[i]);
+		}
+		pthread_mutex_unlock(&o.m);
+	}
+
+	// pop returns a node of f from the open list of id, or else steals
+	// half of the nodes of f and the largest g of the first other thread
+	// that has any.
+	Node *pop(int id, unsigned int f) {
+		Node *n = take(open[id], f);
+		if (n)
+			return n;
+		std::vector<Node*> stolen;
+		for (int i = 1; i < tnum && stolen.empty(); ++i) {
+			Open &o = open[(id + i) % tnum];
+			if (pthread_mutex_trylock(&o.m) != 0)
+				continue;
+			if (f < o.fs.size() && o.fs[f].fill > 0) {
+				std::vector<Node*> &v = o.fs[f].bin();
+				unsigned int half = v.size() - v.size() / 2;
+				stolen.assign(v.end() - half, v.end());
+				v.resize(v.size() - half);
+				o.fs[f].fill -= half;
+			}
+			pthread_mutex_unlock(&o.m);
+		}
+		if (stolen.empty())
+			return 0;
+		++steals[id];
+		n = stolen.back();
+		stolen.pop_back();
+		push(id, stolen);
+		return n;
+	}
+
+	Node *take(Open &o, unsigned int f) {
+		Node *n = 0;
+		pthread_mutex_lock(&o.m);
+		if (f < o.fs.size() && o.fs[f].fill > 0) {
+			std::vector<Node*> &v = o.fs[f].bin();
+			n = v.back();
+			v.pop_back();
+			--o.fs[f].fill;
+		}
+		pthread_mutex_unlock(&o.m);
+		return n;
+	}
+
+	Node *wrap(typename D::State &s, Node *p, int c, int pop,
+			Pool<Node> &nodes) {
+		Node *n = nodes.construct();
+		n->g = c + p->g;
+		n->f = n->g + this->dom.h(s);
+		n->pop = pop;
+		n->parent = p;
+		this->dom.pack(n->packed, s);
+		return n;
+	}
+};
+
+#endif /* PASE_HPP_ */
@@ -0,0 +1,295 @@
+/*
+ * pidastar.hpp
+ *
+ * Parallel IDA*. The top of the search tree is expanded breadth-first
+ * until there are about units_per_thread nodes per thread; the subtrees
+ * under those nodes are the work units. In each iteration every thread
+ * owns a deque holding a contiguous block of the units, runs them
+ * depth-first from the front (the serial order) and, when it runs out,
+ * steals from the back of the other threads' deques.
+ * The next bound (minoob) is shared atomically and the first thread to
+ * find a goal stops the others.
+ */
+
+#ifndef PIDASTAR_HPP_
+#define PIDASTAR_HPP_
+
+#include "search.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <pthread.h>
+
+template<class D> class PIdastar: public SearchAlg<D> {
+
+	// Unit is a subtree root at the frontier together with the path to
+	// it, so that it can be pruned like the serial search would and
+	// the solution path can be rebuilt.
+	struct Unit {
+		typename D::State state;
+		int g, pop;
+		std::vector<typename D::State> path; // root, ..., parent
+		std::vector<int> fs; // f of each node on path
+	};
+
+	struct Deque {
+		std::deque<Unit*> units;
+		pthread_mutex_t m;
+	};
+
+	int tnum;
+	unsigned int units_per_thread;
+
+	std::vector<Unit*> frontier;
+	Deque* deques;
+
+	int bound;
+	std::atomic<int> minoob;
+	std::atomic<bool> found;
+	std::atomic<int> thread_id;
+
+	std::vector<typename D::State> path;
+
+	// A goal above the frontier; used once bound reaches its cost.
+	std::vector<typename D::State> shallow_path;
+	int shallow_cost;
+
+	std::vector<unsigned long> expd_distribution, gend_distribution;
+	std::vector<unsigned long> steals;
+
+public:
+
+	PIdastar(D &d, int tnum_, unsigned int units_per_thread_ = 64) :
+			SearchAlg<D>(d), tnum(tnum_), units_per_thread(units_per_thread_), bound(
+					0), minoob(-1), found(false), thread_id(0), shallow_cost(-1) {
+		deques = new Deque[tnum];
+		for (int i = 0; i < tnum; ++i)
+			pthread_mutex_init(&deques[i].m, NULL);
+		expd_distribution.resize(tnum);
+		gend_distribution.resize(tnum);
+		steals.resize(tnum);
+	}
+
+	~PIdastar() {
+		for (unsigned int i = 0; i < frontier.size(); ++i)
+			delete frontier[i];
+		for (int i = 0; i < tnum; ++i)
+			pthread_mutex_destroy(&deques[i].m);
+		delete[] deques;
+	}
+
+	virtual std::vector<typename D::State> search(typename D::State &root) {
+		split(root);
+		dfpair(stdout, "work units", "%lu", (unsigned long) frontier.size());
+
+		bound = this->dom.h(root);
+
+		dfrowhdr(stdout, "iteration", 4, "number", "bound", "nodes expanded",
+				"nodes generated");
+		unsigned int n = 0;
+		do {
+			if (shallow_cost >= 0 && shallow_cost <= bound) {
+				path = shallow_path;
+				break;
+			}
+			minoob = -1;
+			iteration();
+			n++;
+			dfrow(stdout, "iteration", "uduu", (unsigned long) n, (long) bound,
+					this->expd, this->gend);
+			bound = minoob;
+		} while (path.size() == 0 && bound >= 0);
+
+		unsigned long steal = 0;
+		for (int i = 0; i < tnum; ++i)
+			steal += steals[i];
+		dfpair(stdout, "steals", "%lu", steal);
+
+		return path;
+	}
+
+private:
+
+	// split expands the tree breadth-first until the frontier has
+	// tnum * units_per_thread nodes or stops growing.
+	void split(typename D::State &root) {
+		Unit* u = new Unit;
+		u->state = root;
+		u->g = 0;
+		u->pop = -1;
+		frontier.push_back(u);
+
+		while (frontier.size() < tnum * units_per_thread) {
+			std::vector<Unit*> next;
+			for (unsigned int i = 0; i < frontier.size(); ++i) {
+				Unit* p = frontier[i];
+				int f = p->g + this->dom.h(p->state);
+				if (this->dom.isgoal(p->state)) {
+					if (shallow_cost < 0 || p->g < shallow_cost) {
+						shallow_cost = p->g;
+						shallow_path.clear();
+						shallow_path.push_back(p->state);
+						for (int j = p->path.size() - 1; j >= 0; --j)
+							shallow_path.push_back(p->path[j]);
+					}
+				}
+				this->expd++;
+				int nops = this->dom.nops(p->state);
+				for (int j = 0; j < nops; ++j) {
+					int op = this->dom.nthop(p->state, j);
+					if (op == p->pop)
+						continue;
+					this->gend++;
+					Unit* c = new Unit;
+					c->state = p->state;
+					Edge<D> e = this->dom.apply(c->state, op);
+					c->g = p->g + e.cost;
+					c->pop = e.pop;
+					c->path = p->path;
+					c->path.push_back(p->state);
+					c->fs = p->fs;
+					c->fs.push_back(f);
+					next.push_back(c);
+				}
+				delete p;
+			}
+			if (next.empty())
+				break;
+			frontier.swap(next);
+		}
+	}
+
+	void iteration() {
+		for (unsigned int i = 0; i < frontier.size(); ++i)
+			deques[i * tnum / frontier.size()].units.push_back(frontier[i]);
+
+		thread_id = 0;
+		pthread_t t[tnum];
+		for (int i = 0; i < tnum; ++i) {
+			pthread_create(&t[i], NULL,
+					(void*(*)(void*))&PIdastar::thread_helper, this);
+		}
+		for (int i = 0; i < tnum; ++i) {
+			pthread_join(t[i], NULL);
+		}
+
+		for (int i = 0; i < tnum; ++i) {
+			deques[i].units.clear();
+			this->expd += expd_distribution[i];
+			this->gend += gend_distribution[i];
+			expd_distribution[i] = 0;
+			gend_distribution[i] = 0;
+		}
+	}
+
+	static void* thread_helper(void* arg) {
+		return static_cast<PIdastar*>(arg)->thread_search();
+	}
+
+	// next returns the next unit for thread id: the first of its own, or
+	// the last of another thread. 0 if all deques are empty.
+	Unit* next(int id) {
+		Unit* u = 0;
+		pthread_mutex_lock(&deques[id].m);
+		if (!deques[id].units.empty()) {
+			u = deques[id].units.front();
+			deques[id].units.pop_front();
+		}
+		pthread_mutex_unlock(&deques[id].m);
+		for (int i = 1; !u && i < tnum; ++i) {
+			Deque &v = deques[(id + i) % tnum];
+			pthread_mutex_lock(&v.m);
+			if (!v.units.empty()) {
+				u = v.units.back();
+				v.units.pop_back();
+				++steals[id];
+			}
+			pthread_mutex_unlock(&v.m);
+		}
+		return u;
+	}
+
+	void* thread_search() {
+		int id = thread_id.fetch_add(1);
+		std::vector<typename D::State> suffix;
+		unsigned long expd = 0, gend = 0;
+
+		Unit* u;
+		while (!found.load(std::memory_order_relaxed) && (u = next(id))) {
+			int oob = -1;
+
+			// The serial search would stop at the first node above the
+			// unit that exceeds the bound.
+			unsigned int i = 0;
+			while (i < u->fs.size() && u->fs[i] <= bound)
+				++i;
+			if (i < u->fs.size()) {
+				oob = u->fs[i];
+			} else {
+				typename D::State s = u->state;
+				if (dfs(s, u->g, u->pop, oob, suffix, expd, gend)) {
+					bool f = false;
+					if (found.compare_exchange_strong(f, true)) {
+						path = suffix;
+						for (int j = u->path.size() - 1; j >= 0; --j)
+							path.push_back(u->path[j]);
+					}
+				}
+			}
+
+			if (oob >= 0) {
+				int m = minoob.load();
+				while ((m < 0 || oob < m)
+						&& !minoob.compare_exchange_weak(m, oob))
+					;
+			}
+		}
+
+		expd_distribution[id] = expd;
+		gend_distribution[id] = gend;
+		return 0;
+	}
+
+	bool dfs(typename D::State &n, int cost, int pop, int &oob,
+			std::vector<typename D::State> &suffix, unsigned long &expd,
+			unsigned long &gend) {
+		int f = cost + this->dom.h(n);
+
+		if (f <= bound && this->dom.isgoal(n)) {
+			suffix.push_back(n);
+			return true;
+		}
+
+		if (f > bound) {
+			if (oob < 0 || f < oob)
+				oob = f;
+			return false;
+		}
+
+		if (found.load(std::memory_order_relaxed))
+			return false;
+
+		expd++;
+		int nops = this->dom.nops(n);
+		for (int i = 0; i < nops; i++) {
+			int op = this->dom.nthop(n, i);
+			if (op == pop)
+				continue;
+
+			gend++;
+			Edge<D> e = this->dom.apply(n, op);
+			bool goal = dfs(n, e.cost + cost, e.pop, oob, suffix, expd, gend);
+			this->dom.undo(n, e);
+			if (goal) {
+				suffix.push_back(n);
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+#endif /* PIDASTAR_HPP_ */
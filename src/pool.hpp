@@ -10,7 +10,7 @@
 template <class Obj> class Pool {
 public:
 
-	Pool(unsigned int sz = 1024) : blksz(sz), nxt(0), freed(0) {
+	Pool(unsigned int sz = 1024) : blksz(sz), nxt(0), cur(0), freed(0) {
 		newblk();
 	}
 
@@ -28,10 +28,30 @@ public:
 			return (Obj*) res->bytes;
 		}
 
-		if (nxt == blksz)
-			newblk();
+		if (nxt == blksz) {
+			if (cur + 1 < blks.size()) {
+				++cur;
+				nxt = 0;
+			} else {
+				newblk();
+			}
+		}
+
+		return (Obj*) blks[cur][nxt++].bytes;
+	}
+
+	// reset frees every object at once. The blocks are kept and
+	// handed out again, so a pool can be reused across searches.
+	void reset(void) {
+		cur = 0;
+		nxt = 0;
+		freed = 0;
+	}
 
-		return (Obj*) blks.back()[nxt++].bytes;
+	// bytes returns the memory of the blocks handed out since the pool
+	// was made or reset; blocks kept by reset for reuse are not counted.
+	unsigned long bytes(void) const {
+		return (cur + 1) * (unsigned long) blksz * sizeof(Ent);
 	}
 
 	void put(Obj *o) {
@@ -62,6 +82,7 @@ private:
 	void newblk(void) {
 		Ent *blk = new Ent[blksz];
 		blks.push_back(blk);
+		cur = blks.size() - 1;
 		nxt = 0;
 	}
 
@@ -77,7 +98,7 @@ private:
 //	}
 
 
-	unsigned int blksz, nxt;
+	unsigned int blksz, nxt, cur;
 	Ent *freed;
 	std::vector<Ent*> blks;
 };
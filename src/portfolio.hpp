@@ -0,0 +1,170 @@
+/*
+ * portfolio.hpp
+ *
+ * Portfolio runs differently configured searches on one instance at the
+ * same time, each on its own copy of the domain with its own heuristic
+ * and distribution hash. The members share a SharedIncumbent: they prune
+ * nodes with g + h >= the best solution cost any of them has found, and
+ * all of them stop once an admissible member (HDA* or IDA*; weighted
+ * HDA* is anytime and ends at weight 1) is done, which proves the
+ * incumbent optimal. Weighted A* only supplies solutions.
+ *
+ * A member runs on threads threads (HDA* only) and, if cpus is not
+ * empty, only on those CPUs.
+ *
+ * Requires D::set_heuristic and D::set_dist_hash (Tiles).
+ */
+
+#ifndef PORTFOLIO_HPP_
+#define PORTFOLIO_HPP_
+
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+#include "search.hpp"
+#include "utils.hpp"
+#include "fatal.hpp"
+#include "shared_incumbent.hpp"
+#include "hdastar.hpp"
+#include "astar.hpp"
+#include "idastar.hpp"
+
+template<class D> class Portfolio: public SearchAlg<D> {
+public:
+
+	enum Algorithm {
+		HDASTAR, WASTAR, IDASTAR,
+	};
+
+private:
+
+	struct Member {
+		Algorithm alg;
+		int threads;
+		double weight;
+		int heuristic, dist_hash;
+		std::vector<int> cpus;
+
+		Portfolio* portfolio;
+		unsigned long expd, gend;
+		double wall;
+		long length; // of the path it returned, -1 if none
+	};
+
+	std::vector<Member> members;
+	SharedIncumbent<D> incumbent;
+	unsigned int closedlistsize;
+	typename D::State init;
+
+public:
+
+	Portfolio(D &d, unsigned int closedlistsize = 110503) :
+			SearchAlg<D>(d), closedlistsize(closedlistsize) {
+	}
+
+	// add adds a member. weight is that of the heuristic; for HDA* above 1
+	// it is anytime weighted HDA* from weight down to 1.
+	void add(Algorithm alg, int threads = 1, double weight = 1.0,
+			int heuristic = 0, int dist_hash = 0,
+			std::vector<int> cpus = std::vector<int>()) {
+		if (alg == IDASTAR && weight != 1.0)
+			throw Fatal("Portfolio: IDA* is not weighted");
+		Member m;
+		m.alg = alg;
+		m.threads = alg == HDASTAR ? threads : 1;
+		m.weight = weight;
+		m.heuristic = heuristic;
+		m.dist_hash = dist_hash;
+		m.cpus = cpus;
+		m.portfolio = this;
+		m.expd = m.gend = 0;
+		m.wall = 0;
+		m.length = -1;
+		members.push_back(m);
+	}
+
+	std::vector<typename D::State> search(typename D::State &init) {
+		if (members.empty())
+			throw Fatal("Portfolio: no member");
+		this->init = init;
+		std::vector<pthread_t> t(members.size());
+		for (unsigned int i = 0; i < members.size(); ++i)
+			pthread_create(&t[i], NULL, &Portfolio::member_helper, &members[i]);
+		for (unsigned int i = 0; i < members.size(); ++i)
+			pthread_join(t[i], NULL);
+
+		dfrowhdr(stdout, "portfolio member", 9, "algorithm", "threads",
+				"weight", "heuristic", "dist hash", "nodes expanded",
+				"nodes generated", "wall time", "path length");
+		for (unsigned int i = 0; i < members.size(); ++i) {
+			Member &m = members[i];
+			this->expd += m.expd;
+			this->gend += m.gend;
+			dfrow(stdout, "portfolio member", "ddgdduugd", (long) m.alg,
+					(long) m.threads, m.weight, (long) m.heuristic,
+					(long) m.dist_hash, m.expd, m.gend, m.wall, m.length);
+		}
+		this->wtime = walltime();
+		this->ctime = cputime();
+		return incumbent.path;
+	}
+
+private:
+
+	static void* member_helper(void* arg) {
+		Member *m = static_cast<Member*>(arg);
+		m->portfolio->run(*m);
+		return 0;
+	}
+
+	void run(Member &m) {
+		if (!m.cpus.empty()) {
+			// Threads created from here on (HDA*) inherit the mask.
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (unsigned int i = 0; i < m.cpus.size(); ++i)
+				CPU_SET(m.cpus[i], &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		}
+
+		D dom(this->dom);
+		dom.set_heuristic(m.heuristic);
+		dom.set_dist_hash(m.dist_hash);
+		typename D::State s = init;
+
+		SearchAlg<D> *alg;
+		bool admissible = true;
+		switch (m.alg) {
+		case HDASTAR: {
+			HDAstar<D> *h = new HDAstar<D>(dom, m.threads, 1000000, 10000000,
+					0, 0, closedlistsize, 200 * m.weight);
+			if (m.weight > 1.0)
+				h->set_anytime(m.weight, m.weight - 1.0);
+			alg = h;
+			break;
+		}
+		case WASTAR:
+			alg = new Astar<D>(dom, 200 * m.weight, m.weight, 1000000,
+					closedlistsize);
+			admissible = m.weight == 1.0;
+			break;
+		default:
+			alg = new Idastar<D>(dom);
+			break;
+		}
+		alg->shared = &incumbent;
+
+		double w = walltime();
+		std::vector<typename D::State> path = alg->search(s);
+		m.wall = walltime() - w;
+		m.expd = alg->expd;
+		m.gend = alg->gend;
+		m.length = (long) path.size() - 1;
+		if (admissible)
+			incumbent.stop = true;
+		delete alg;
+	}
+};
+
+#endif /* PORTFOLIO_HPP_ */
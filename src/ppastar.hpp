@@ -20,6 +20,7 @@
 #include "utils.hpp"
 #include "concurrent_hashtbl.hpp"
 #include "concurrent_heap.hpp"
+#include "multiqueue.hpp"
 #include "pool.hpp"
 #include "buffer.hpp"
 
@@ -169,11 +170,18 @@ template<class D, class hash> class PPAstar: public SearchAlg<D> {
 
 	int overrun;
 //	unsigned int closedlistsize;
+#ifdef CONCURRENT_HEAP
 	ConcurrentHeap<Node> open;
+#else
+	MultiQueue<Node> open;
+#endif
 	ConcurrentHashTable<typename D::PackedState, Node> closed; // shared closed list
 
 public:
 
+	// With MultiQueue (unless CONCURRENT_HEAP) openlistdivision is the
+	// number of queues and min_expd the size of the insertion buffers;
+	// the synchronous flags are ConcurrentHeap's only.
 	PPAstar(D &d, int tnum_, int income_threshold_,
 			int outgo_threshold_, int abst_, int overrun_,
 			unsigned int openlistsize, unsigned int openlistdivision,
@@ -184,8 +192,12 @@ public:
 					static_cast<typename hash::ABST>(abst_)), incumbent(INIT_INCUMBENT), income_threshold(
 					income_threshold_), outgo_threshold(outgo_threshold_), globalOrder(
 					0), overrun(overrun_),
+#ifdef CONCURRENT_HEAP
 					open(openlistsize, openlistdivision, tnum_,
 							open_synchronous_push, open_synchronous_pop, min_expd),
+#else
+					open(openlistsize, openlistdivision, tnum_, min_expd),
+#endif
 					closed(closedlistsize, closedlistdivision) {
 //		income_buffer = new buffer<Node> [tnum];
 		terminate = new bool[tnum];
@@ -296,6 +308,7 @@ public:
 				}
 				continue; // ad hoc
 			}
+			terminate[id] = false;
 			n = static_cast<Node*>(open.pop(id));
 
 			if (n == NULL) {
@@ -525,11 +538,11 @@ public:
 #endif
 
 		for (int i = 0; i < tnum; ++i) {
-			pthread_create(&t[tnum], NULL,
+			pthread_create(&t[i], NULL,
 					(void*(*)(void*))&PPAstar::thread_helper, this);
 				}
 		for (int i = 0; i < tnum; ++i) {
-			pthread_join(t[tnum], NULL);
+			pthread_join(t[i], NULL);
 		}
 
 //		sleep(2);
@@ -20,6 +20,8 @@ template<class D> struct Edge {
 	typename D::Undo undo;
 };
 
+template<class D> class SharedIncumbent;
+
 // SearchAlg defines the common interface to all search
 // algorithms.
 template<class D> struct SearchAlg {
@@ -28,6 +30,8 @@ template<class D> struct SearchAlg {
 	// searches in the given domain.
 	SearchAlg(D &d) : dom(d), expd(0), gend(0), lpush(0), dup(0), incm(0) { }
 
+	virtual ~SearchAlg() { }
+
 	// search searches for a goal from the initial state
 	// The return value is the path to the goal which can
 	// be empty if the goal was no found.
@@ -54,6 +58,9 @@ template<class D> struct SearchAlg {
 	bool isTimed = false;
 	unsigned int incm;
 
+	// shared is set on a member of a portfolio (shared_incumbent.hpp).
+	SharedIncumbent<D> *shared = 0;
+
 	double wtime, ctime;
 };
 
@@ -0,0 +1,47 @@
+/*
+ * shared_incumbent.hpp
+ *
+ * SharedIncumbent is what the members of a portfolio (portfolio.hpp)
+ * share: the best solution so far and whether the search is over. A
+ * member with SearchAlg::shared set prunes nodes with g + h >= cost,
+ * offers every solution it finds and returns once stop is set.
+ */
+
+#ifndef SHARED_INCUMBENT_HPP_
+#define SHARED_INCUMBENT_HPP_
+
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+
+template<class D> class SharedIncumbent {
+public:
+
+	SharedIncumbent(int maxcost = 1000000) :
+			cost(maxcost), stop(false) {
+		pthread_mutex_init(&m, NULL);
+	}
+
+	~SharedIncumbent() {
+		pthread_mutex_destroy(&m);
+	}
+
+	// offer takes path, of cost c, if it is the best so far.
+	void offer(int c, const std::vector<typename D::State> &p) {
+		pthread_mutex_lock(&m);
+		if (c < cost) {
+			path = p;
+			cost = c;
+		}
+		pthread_mutex_unlock(&m);
+	}
+
+	std::atomic<int> cost;
+	std::atomic<bool> stop;
+	std::vector<typename D::State> path; // of cost, once the search is over
+
+private:
+	pthread_mutex_t m;
+};
+
+#endif /* SHARED_INCUMBENT_HPP_ */
@@ -0,0 +1,418 @@
+/*
+ * sliding_tiles.hpp
+ *
+ * SlidingTiles<W, H> is the W x H sliding-tile puzzle. It has the
+ * same interface as Tiles and Tiles24 and can be used by the same
+ * search algorithms, e.g. SlidingTiles<3, 3>, <4, 5> or <6, 6>.
+ *
+ * Each tile takes the fewest bits that hold W * H - 1, and the packed
+ * state uses as many 64-bit words as those bits need (one for 3x3 and
+ * 4x4, two for 4x5 and 5x5, four for 6x6). The operator, Manhattan
+ * distance and Manhattan increment tables are built at compile time.
+ *
+ * Heuristics (set_heuristic): 0 Manhattan distance, 2 blind.
+ */
+
+#ifndef SLIDING_TILES_HPP_
+#define SLIDING_TILES_HPP_
+
+#include "search.hpp"
+#include "fatal.hpp"
+#include "dist_hash.hpp"
+#include "zobrist.hpp"
+
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+#include <memory>
+
+// IndexSeq<0, ..., N - 1> is built in log N steps so that the tables
+// of the larger boards (46656 entries for 6x6) stay within the
+// template depth limit.
+template<int ... Is> struct IndexSeq {
+};
+
+template<class A, class B> struct ConcatSeq;
+
+template<int ... As, int ... Bs> struct ConcatSeq<IndexSeq<As...>, IndexSeq<Bs...> > {
+	typedef IndexSeq<As..., (sizeof...(As) + Bs)...> type;
+};
+
+template<int N> struct MakeSeq {
+	typedef typename ConcatSeq<typename MakeSeq<N / 2>::type,
+			typename MakeSeq<N - N / 2>::type>::type type;
+};
+
+template<> struct MakeSeq<0> {
+	typedef IndexSeq<> type;
+};
+
+template<> struct MakeSeq<1> {
+	typedef IndexSeq<0> type;
+};
+
+template<class T, int N> struct ConstArray {
+	T v[N];
+
+	constexpr const T &operator[](int i) const {
+		return v[i];
+	}
+};
+
+// Table generators. These are C++11 constexpr functions, so each is a
+// single expression.
+template<int W, int H> struct SlidingTilesTables {
+	enum {
+		N = W * H,
+	};
+
+	struct Ops {
+		int n, ops[4];
+	};
+
+	static constexpr int iabs(int x) {
+		return x < 0 ? -x : x;
+	}
+
+	// md of tile t at position p; 0 for the blank.
+	static constexpr int md(int t, int p) {
+		return t == 0 ? 0 : iabs(t / W - p / W) + iabs(t % W - p % W);
+	}
+
+	// The change in md when tile t moves from position from to position to.
+	static constexpr int mdincr(int i) {
+		return md(i / (N * N), i % N) - md(i / (N * N), i / N % N);
+	}
+
+	// Candidate blank moves from b in the order of Tiles::initoptab:
+	// up, left, right, down.
+	static constexpr bool valid(int b, int c) {
+		return c == 0 ? b >= W : c == 1 ? b % W > 0 :
+				c == 2 ? b % W < W - 1 : b < N - W;
+	}
+
+	static constexpr int cand(int b, int c) {
+		return c == 0 ? b - W : c == 1 ? b - 1 : c == 2 ? b + 1 : b + W;
+	}
+
+	static constexpr int nthop(int b, int k, int c = 0) {
+		return c == 4 ? -1 :
+				!valid(b, c) ? nthop(b, k, c + 1) :
+				k == 0 ? cand(b, c) : nthop(b, k - 1, c + 1);
+	}
+
+	static constexpr Ops ops(int b) {
+		return Ops { valid(b, 0) + valid(b, 1) + valid(b, 2) + valid(b, 3), {
+				nthop(b, 0), nthop(b, 1), nthop(b, 2), nthop(b, 3) } };
+	}
+
+	template<int ... Is>
+	static constexpr ConstArray<Ops, N> optab(IndexSeq<Is...>) {
+		return ConstArray<Ops, N> { { ops(Is)... } };
+	}
+
+	template<int ... Is>
+	static constexpr ConstArray<signed char, N * N> mdtab(IndexSeq<Is...>) {
+		return ConstArray<signed char, N * N> { {
+				static_cast<signed char>(md(Is / N, Is % N))... } };
+	}
+
+	template<int ... Is>
+	static constexpr ConstArray<signed char, N * N * N> mdincrtab(
+			IndexSeq<Is...>) {
+		return ConstArray<signed char, N * N * N> { {
+				static_cast<signed char>(mdincr(Is))... } };
+	}
+};
+
+template<int W, int H> struct SlidingTiles {
+	enum {
+		Width = W, Height = H, Ntiles = W * H,
+	};
+
+	typedef SlidingTilesTables<W, H> Tables;
+
+	// Bits per tile and 64-bit words per packed state.
+	static constexpr int bits(int n, int b = 0) {
+		return (1 << b) >= n ? b : bits(n, b + 1);
+	}
+	enum {
+		Bits = bits(Ntiles), Nwords = (Ntiles * Bits + 63) / 64,
+	};
+
+	struct State {
+		char tiles[Ntiles]; // tiles[a] = b means tile b is at position a.
+		char blank;
+		char h;
+	};
+
+	// Tile i is stored at bit (Ntiles - 1 - i) * Bits of the
+	// little-endian word array, so 4x4 packs as Tiles and 5x5 as Tiles24.
+	struct PackedState {
+		uint64_t word[Nwords];
+
+		unsigned long hash() const {
+			uint64_t h = word[0];
+			for (int i = 1; i < Nwords; ++i)
+				h = (h ^ word[i]) * 0x9E3779B97F4A7C15ULL;
+			return h;
+		}
+
+		bool eq(const PackedState &h) const {
+			for (int i = 0; i < Nwords; ++i)
+				if (word[i] != h.word[i])
+					return false;
+			return true;
+		}
+
+		unsigned int byteSize() const {
+			return 8 * Nwords;
+		}
+
+		// Most significant byte first.
+		void stateToChars(unsigned char* d) const {
+			for (int i = 0; i < 8 * Nwords; ++i) {
+				int b = 8 * Nwords - 1 - i;
+				d[i] = (word[b / 8] >> (8 * (b % 8))) & 0xff;
+			}
+		}
+
+		void charsToState(unsigned char* d) {
+			for (int i = 0; i < Nwords; ++i)
+				word[i] = 0;
+			for (int i = 0; i < 8 * Nwords; ++i) {
+				int b = 8 * Nwords - 1 - i;
+				word[b / 8] |= (uint64_t) d[i] << (8 * (b % 8));
+			}
+		}
+
+		// Host byte order, for mpi/wire_format.hpp.
+		static const unsigned int wire_bytes = 8 * Nwords;
+
+		void to_wire(unsigned char* d) const {
+			memcpy(d, word, 8 * Nwords);
+		}
+
+		void from_wire(const unsigned char* d) {
+			memcpy(word, d, 8 * Nwords);
+		}
+	};
+
+	// SlidingTiles reads the initial state in Wheeler's tiles format.
+	SlidingTiles(FILE *in) :
+			which_heuristic(0), dist_h(0) {
+		unsigned int w, h;
+		if (fscanf(in, " %u %u", &w, &h) != 2)
+			throw Fatal("Failed to read width and height");
+		if (w != Width || h != Height)
+			throw Fatal("Width and height instance/compiler option mismatch");
+		if (fscanf(in, " starting positions for each tile:") != 0)
+			throw Fatal("Failed to read the starting position label");
+		for (int t = 0; t < Ntiles; t++) {
+			int p;
+			int r = fscanf(in, " %d", &p);
+			if (r != 1)
+				throw Fatal("Failed to read the starting positions: r=%d", r);
+			init[t] = p;
+		}
+		if (fscanf(in, " goal positions:") != 0)
+			throw Fatal("Failed to read the goal position label");
+		for (int t = 0; t < Ntiles; t++) {
+			int p;
+			if (fscanf(in, " %d", &p) != 1)
+				throw Fatal("Failed to read the goal position");
+			if (p != t)
+				throw Fatal("Non-canonical goal positions");
+		}
+	}
+
+	// SlidingTiles reads the line-th instance of a file with one
+	// instance of Ntiles numbers per line.
+	SlidingTiles(FILE *in, int line) :
+			which_heuristic(0), dist_h(0) {
+		for (int i = 0; i < line; ++i) {
+			for (int t = 0; t < Ntiles; t++) {
+				int p;
+				int r = fscanf(in, " %d", &p);
+				if (r != 1)
+					throw Fatal("Failed to read the starting positions: r=%d",
+							r);
+				init[t] = p;
+			}
+		}
+	}
+
+	State initial() const {
+		State s;
+		s.blank = -1;
+		for (int i = 0; i < Ntiles; i++) {
+			if (init[i] == 0)
+				s.blank = i;
+			s.tiles[i] = init[i];
+		}
+		if (s.blank < 0)
+			throw Fatal("No blank tile");
+		s.h = heuristic(s.tiles);
+		return s;
+	}
+
+	int h(const State &s) const {
+		return s.h;
+	}
+
+	bool isgoal(const State &s) const {
+		if (which_heuristic == 0)
+			return s.h == 0;
+		for (int i = 0; i < Ntiles; ++i)
+			if (i != s.blank && s.tiles[i] != i)
+				return false;
+		return s.blank == 0;
+	}
+
+	int nops(const State &s) const {
+		return optab[(int) s.blank].n;
+	}
+
+	int nthop(const State &s, int n) const {
+		return optab[(int) s.blank].ops[n];
+	}
+
+	std::vector<unsigned int> ops(const State &s) const {
+		return std::vector<unsigned int>(optab[(int) s.blank].ops,
+				optab[(int) s.blank].ops + optab[(int) s.blank].n);
+	}
+
+	struct Undo {
+		int h, blank;
+	};
+
+	Edge<SlidingTiles> apply(State &s, int newb) const {
+		Edge<SlidingTiles> e(1, newb, s.blank);
+		e.undo.h = s.h;
+		e.undo.blank = s.blank;
+
+		int tile = s.tiles[newb];
+		s.tiles[(int) s.blank] = tile;
+		s.tiles[newb] = 0;
+		if (which_heuristic == 0)
+			s.h += mdincr[(tile * Ntiles + newb) * Ntiles + s.blank];
+		s.blank = newb;
+		return e;
+	}
+
+	void undo(State &s, const Edge<SlidingTiles> &e) const {
+		s.h = e.undo.h;
+		s.tiles[(int) s.blank] = s.tiles[(int) e.undo.blank];
+		s.tiles[(int) e.undo.blank] = 0;
+		s.blank = e.undo.blank;
+	}
+
+	// pack packs state s into the packed state dst.
+	void pack(PackedState &dst, State &s) const {
+		s.tiles[(int) s.blank] = 0;
+		for (int i = 0; i < Nwords; ++i)
+			dst.word[i] = 0;
+		for (int i = 0; i < Ntiles; ++i) {
+			int off = (Ntiles - 1 - i) * Bits;
+			uint64_t t = s.tiles[i];
+			dst.word[off / 64] |= t << (off % 64);
+			if (off % 64 + Bits > 64) // straddles two words
+				dst.word[off / 64 + 1] |= t >> (64 - off % 64);
+		}
+	}
+
+	// unpack unpacks the packed state s into the state dst.
+	void unpack(State &dst, const PackedState &s) const {
+		const uint64_t mask = (1 << Bits) - 1;
+		dst.blank = -1;
+		for (int i = 0; i < Ntiles; ++i) {
+			int off = (Ntiles - 1 - i) * Bits;
+			uint64_t t = s.word[off / 64] >> (off % 64);
+			if (off % 64 + Bits > 64)
+				t |= s.word[off / 64 + 1] << (64 - off % 64);
+			dst.tiles[i] = t & mask;
+			if (dst.tiles[i] == 0)
+				dst.blank = i;
+		}
+		dst.h = heuristic(dst.tiles);
+		assert(dst.blank >= 0);
+	}
+
+	void set_heuristic(int h) {
+		if (h != 0 && h != 2)
+			throw Fatal("SlidingTiles: unknown heuristic %d", h);
+		which_heuristic = h;
+	}
+
+	void print_state(const State &s) const {
+		printf("h=%d: ", s.h);
+		for (int i = 0; i < Ntiles; ++i) {
+			printf("%d ", s.tiles[i]);
+		}
+		printf("\n");
+	}
+
+	// The abstractions of Zobrist hard-coded for 4x4 or 5x5 throw Fatal
+	// on other sizes.
+	void set_dist_hash(int h, int rand_seed = 0) {
+		which_dist_hash = h;
+		zobrist.reset(
+				new Zobrist<SlidingTiles, Ntiles>(which_dist_hash, rand_seed));
+		dist_h = zobrist.get();
+	}
+
+	unsigned int dist_hash(const State &s) const {
+		return dist_h->dist_h(s);
+	}
+
+private:
+
+	int heuristic(const char tiles[]) const {
+		if (which_heuristic != 0)
+			return 0;
+		int sum = 0;
+		for (int i = 0; i < Ntiles; i++)
+			sum += md[tiles[i] * Ntiles + i];
+		return sum;
+	}
+
+	int which_heuristic;
+
+	// init is the initial tile positions.
+	int init[Ntiles];
+
+	int which_dist_hash;
+	DistributionHash<SlidingTiles>* dist_h;
+	std::shared_ptr<Zobrist<SlidingTiles, Ntiles> > zobrist; // shared by copies
+
+	// optab is indexed by the blank position. Each entry is a
+	// description of the possible next blank positions.
+	typedef ConstArray<typename Tables::Ops, Ntiles> OpTable;
+	typedef ConstArray<signed char, Ntiles * Ntiles> MdTable;
+	typedef ConstArray<signed char, Ntiles * Ntiles * Ntiles> MdincrTable;
+
+	static constexpr OpTable optab =
+			Tables::optab(typename MakeSeq<Ntiles>::type());
+
+	// md[tile * Ntiles + position] is the Manhattan distance of the tile.
+	static constexpr MdTable md =
+			Tables::mdtab(typename MakeSeq<Ntiles * Ntiles>::type());
+
+	// mdincr[(tile * Ntiles + from) * Ntiles + to] is the change in
+	// Manhattan distance when the tile slides from from to to.
+	static constexpr MdincrTable mdincr = Tables::mdincrtab(
+					typename MakeSeq<Ntiles * Ntiles * Ntiles>::type());
+};
+
+template<int W, int H>
+constexpr typename SlidingTiles<W, H>::OpTable SlidingTiles<W, H>::optab;
+
+template<int W, int H>
+constexpr typename SlidingTiles<W, H>::MdTable SlidingTiles<W, H>::md;
+
+template<int W, int H>
+constexpr typename SlidingTiles<W, H>::MdincrTable SlidingTiles<W, H>::mdincr;
+
+#endif /* SLIDING_TILES_HPP_ */
@@ -66,7 +66,7 @@ struct Strips {
 		}
 
 		unsigned int byteSize() const {
-			return 4 + 4 + propositions.size() * 4 + 4;
+			return sizeof word + 4 + propositions.size() * 4 + 4;
 		}
 
 		template<typename T>
@@ -85,25 +85,29 @@ struct Strips {
 			}
 		}
 
+		// word takes sizeof word (8) bytes, the size 4 and each
+		// proposition and h 4.
 		void stateToChars(unsigned char* d) const {
+			const int w = sizeof word;
 			intToChars(word, &(d[0]));
 			int size = propositions.size();
-			intToChars(size, &(d[4]));
+			intToChars(size, &(d[w]));
 			for (int i = 0; i < size; ++i) {
-				intToChars(propositions[i], &(d[i * 4 + 8]));
+				intToChars(propositions[i], &(d[i * 4 + w + 4]));
 			}
-			intToChars(h, &(d[size * 4 + 8]));
+			intToChars(h, &(d[size * 4 + w + 4]));
 		}
 
 		void charsToState(unsigned char* d) {
+			const int w = sizeof word;
 			charsToData(word, &(d[0]));
 			int size = 0;
-			charsToData(size, &(d[4]));
+			charsToData(size, &(d[w]));
 			propositions.resize(size);
 			for (int i = 0; i < size; ++i) {
-				charsToData(propositions[i], &(d[i * 4 + 8]));
+				charsToData(propositions[i], &(d[i * 4 + w + 4]));
 			}
-			charsToData(h, &(d[size * 4 + 8]));
+			charsToData(h, &(d[size * 4 + w + 4]));
 		}
 	};
 
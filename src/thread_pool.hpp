@@ -0,0 +1,115 @@
+/*
+ * thread_pool.hpp
+ *
+ * A fixed set of worker threads that live as long as the pool, so that
+ * a sequence of searches does not create and join threads for each
+ * one (see batch.hpp).
+ */
+
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+class ThreadPool {
+	struct Task {
+		void* (*fn)(void*);
+		void* arg;
+		int* pending;
+	};
+
+	std::vector<pthread_t> workers;
+	std::deque<Task> tasks;
+	pthread_mutex_t m;
+	pthread_cond_t work, done;
+	bool quit;
+
+	// in_worker is true on the pool's threads.
+	static bool &in_worker() {
+		static __thread bool w = false;
+		return w;
+	}
+
+public:
+
+	ThreadPool(int nthreads) :
+			quit(false) {
+		pthread_mutex_init(&m, NULL);
+		pthread_cond_init(&work, NULL);
+		pthread_cond_init(&done, NULL);
+		workers.resize(nthreads);
+		for (int i = 0; i < nthreads; ++i) {
+			pthread_create(&workers[i], NULL, &ThreadPool::worker_helper, this);
+		}
+	}
+
+	~ThreadPool() {
+		pthread_mutex_lock(&m);
+		quit = true;
+		pthread_cond_broadcast(&work);
+		pthread_mutex_unlock(&m);
+		for (unsigned int i = 0; i < workers.size(); ++i) {
+			pthread_join(workers[i], NULL);
+		}
+		pthread_cond_destroy(&work);
+		pthread_cond_destroy(&done);
+		pthread_mutex_destroy(&m);
+	}
+
+	int size() const {
+		return workers.size();
+	}
+
+	// run calls fn(arg) n times on the workers and returns when all of
+	// them have returned. The calls may wait for each other (e.g. on a
+	// barrier) only if the pool has n idle workers. A single call made
+	// from a worker runs on that worker.
+	void run(int n, void* (*fn)(void*), void* arg) {
+		if (n == 1 && in_worker()) {
+			fn(arg);
+			return;
+		}
+		int pending = n;
+		pthread_mutex_lock(&m);
+		for (int i = 0; i < n; ++i) {
+			Task t = { fn, arg, &pending };
+			tasks.push_back(t);
+		}
+		pthread_cond_broadcast(&work);
+		while (pending > 0)
+			pthread_cond_wait(&done, &m);
+		pthread_mutex_unlock(&m);
+	}
+
+private:
+
+	static void* worker_helper(void* arg) {
+		static_cast<ThreadPool*>(arg)->worker();
+		return 0;
+	}
+
+	void worker() {
+		in_worker() = true;
+		pthread_mutex_lock(&m);
+		for (;;) {
+			while (tasks.empty() && !quit)
+				pthread_cond_wait(&work, &m);
+			if (tasks.empty())
+				break;
+			Task t = tasks.front();
+			tasks.pop_front();
+			pthread_mutex_unlock(&m);
+
+			t.fn(t.arg);
+
+			pthread_mutex_lock(&m);
+			if (--*t.pending == 0)
+				pthread_cond_broadcast(&done);
+		}
+		pthread_mutex_unlock(&m);
+	}
+};
+
+#endif /* THREAD_POOL_HPP_ */
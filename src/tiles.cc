@@ -3,6 +3,7 @@
 // license that can be found in the LICENSE file.
 #include "tiles.hpp"
 #include <string>
+#include <mutex>
 
 Tiles::Tiles(FILE *in) {
 	unsigned int w, h;
@@ -39,6 +40,8 @@ Tiles::Tiles(FILE *in) {
 
 	initmd();
 	initoptab();
+	initlc();
+	kernels = &tiles_kernels();
 }
 
 /**
@@ -60,6 +63,8 @@ Tiles::Tiles(FILE *in, int line) {
 	}
 	initmd();
 	initoptab();
+	initlc();
+	kernels = &tiles_kernels();
 }
 
 void Tiles::initmd() {
@@ -156,3 +161,62 @@ void Tiles::initoptab() {
 		assert(optab[i].n <= 4);
 	}
 }
+
+unsigned char Tiles::lcrow[Width][1 << (4 * Width)];
+unsigned char Tiles::lccol[Height][1 << (4 * Height)];
+
+// lcline returns the linear conflict of line l holding the tiles t[0..3].
+// inl(t, l) tells whether tile t belongs to line l and order(t) is its
+// goal place along the line. Tiles that are not in the longest run in
+// goal order have to leave the line, 2 moves each.
+static int lcline(const int t[], bool (*inl)(int, int), int (*order)(int),
+		int l) {
+	int lis[4];
+	int n = 0, best = 0;
+	for (int i = 0; i < 4; ++i) {
+		if (t[i] == 0 || !inl(t[i], l))
+			continue;
+		lis[i] = 1;
+		for (int j = 0; j < i; ++j)
+			if (t[j] != 0 && inl(t[j], l) && order(t[j]) < order(t[i])
+					&& lis[j] + 1 > lis[i])
+				lis[i] = lis[j] + 1;
+		if (lis[i] > best)
+			best = lis[i];
+		++n;
+	}
+	return 2 * (n - best);
+}
+
+static bool inrow(int t, int r) {
+	return t / Tiles::Width == r;
+}
+
+static bool incol(int t, int c) {
+	return t % Tiles::Width == c;
+}
+
+static int colorder(int t) {
+	return t % Tiles::Width;
+}
+
+static int roworder(int t) {
+	return t / Tiles::Width;
+}
+
+// The tables are built by the first Tiles only: another may be built
+// while threads search with them (Batch, Portfolio).
+void Tiles::initlc() {
+	static std::once_flag built;
+	std::call_once(built, [] {
+		for (int key = 0; key < (1 << (4 * Width)); ++key) {
+			int t[4];
+			for (int i = 0; i < 4; ++i)
+				t[i] = (key >> ((3 - i) * 4)) & 0xF;
+			for (int l = 0; l < Width; ++l) {
+				lcrow[l][key] = lcline(t, inrow, colorder, l);
+				lccol[l][key] = lcline(t, incol, roworder, l);
+			}
+		}
+	});
+}
@@ -5,11 +5,15 @@
 #include "fatal.hpp"
 #include "dist_hash.hpp"
 #include "zobrist.hpp"
+#include "tiles_simd.hpp"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <cstring>
 #include <stdint.h>
+#include <vector>
+#include <memory>
 
 struct Tiles {
 	enum {
@@ -52,6 +56,17 @@ struct Tiles {
 				word += (uint64_t) d[i] << (8 * (n - i - 1));
 			}
 		}
+
+		// Host byte order, for mpi/wire_format.hpp.
+		static const unsigned int wire_bytes = 8;
+
+		void to_wire(unsigned char* d) const {
+			memcpy(d, &word, 8);
+		}
+
+		void from_wire(const unsigned char* d) {
+			memcpy(&word, d, 8);
+		}
 	};
 
 	// Tiles constructs a new instance by reading
@@ -82,6 +97,9 @@ struct Tiles {
 		case 2:
 			s.h = 0;
 			break;
+		case 3:
+			s.h = mdist(s.blank, s.tiles) + lconflict(s.tiles);
+			break;
 		}
 
 		return s;
@@ -99,6 +117,7 @@ struct Tiles {
 
 		switch(which_heuristic) {
 		case 0:
+		case 3: // no linear conflict for backward search
 			s.h = mdistback(s.blank, s.tiles);
 			break;
 		case 1:
@@ -133,6 +152,8 @@ struct Tiles {
 			break;
 		case 2:
 			return displacement(s, -1, 0) == 0;
+		case 3:
+			return s.h == 0;
 		}
 	}
 
@@ -154,14 +175,40 @@ struct Tiles {
 		e.undo.blank = s.blank;
 
 		int tile = s.tiles[newb];
+		int lc = which_heuristic == 3 ? lconflict(s.tiles, newb, s.blank) : 0;
 		s.tiles[(int) s.blank] = tile;
 		s.h = heuristic(s, newb, 0);
 //		s.h += mdincr[tile][newb][(int) s.blank];
+		s.tiles[newb] = 0;
+		if (which_heuristic == 3)
+			s.h += lconflict(s.tiles, newb, s.blank) - lc;
 		s.blank = newb;
 
 		return e;
 	}
 
+	// delta_f returns f(child) - f(s) of moving the blank to newb, the
+	// operator selection function of partial expansion (PARTIAL_EXPANSION
+	// in hdastar.hpp), for heuristics 0 and 3. Manhattan distance is looked
+	// up in mdincr; the linear conflict part is taken from the two lines
+	// the tile crosses. Other heuristics throw Fatal.
+	int delta_f(const State &s, int newb) const {
+		int tile = s.tiles[newb];
+		int df = 1 + mdincr[tile][newb][(int) s.blank];
+		if (which_heuristic == 3) {
+			char tiles[Ntiles];
+			memcpy(tiles, s.tiles, Ntiles);
+			tiles[(int) s.blank] = 0;
+			df -= lconflict(tiles, newb, s.blank);
+			tiles[(int) s.blank] = tile;
+			tiles[newb] = 0;
+			df += lconflict(tiles, newb, s.blank);
+		} else if (which_heuristic != 0) {
+			throw Fatal("Tiles: no delta_f for heuristic %d", which_heuristic);
+		}
+		return df;
+	}
+
 	Edge<Tiles> applybidr(State &s, int newb, bool isbackward) const {
 		if (isbackward) {
 //			printf("applybidr back\n");
@@ -190,6 +237,7 @@ struct Tiles {
 		switch (which_heuristic) {
 		{
 			case 0:
+			case 3: // the linear conflict part is added by apply.
 			// Manhattan distance
 			int tile = s.tiles[newb];
 			if (isbackward) {
@@ -238,30 +286,22 @@ struct Tiles {
 	void undo(State &s, const Edge<Tiles> &e) const {
 		s.h = e.undo.h;
 		s.tiles[(int) s.blank] = s.tiles[(int) e.undo.blank];
+		s.tiles[(int) e.undo.blank] = 0;
 		s.blank = e.undo.blank;
 	}
 
 // pack packes state s into the packed state dst.
 	void pack(PackedState &dst, State &s) const {
-		dst.word = 0; // to make g++ shut up about uninitialized usage.
 		s.tiles[(int) s.blank] = 0;
-		for (int i = 0; i < Ntiles; i++)
-			dst.word = (dst.word << 4) | s.tiles[i]; // TODO: 15 puzzle specific
+		dst.word = kernels->pack16(s.tiles);
 	}
 
 // unpack unpacks the packed state s into the state dst.
 	void unpack(State &dst, PackedState s) const {
-		dst.h = 0;
-		dst.blank = -1;
-		for (int i = Ntiles - 1; i >= 0; i--) {
-			int t = s.word & 0xF; // 15 Puzzle specific
-			s.word >>= 4;
-			dst.tiles[i] = t;
-			if (t == 0)
-				dst.blank = i;
-			else
-				dst.h += md[t][i];
-		}
+		dst.blank = kernels->unpack16(s.word, dst.tiles);
+		dst.h = kernels->manhattan16(dst.tiles);
+		if (which_heuristic == 3)
+			dst.h += lconflict(dst.tiles);
 		assert(dst.blank >= 0);
 	}
 
@@ -307,26 +347,74 @@ struct Tiles {
 
 	void set_dist_hash(int h, int rand_seed = 0) {
 		which_dist_hash = h;
-		dist_h = new Zobrist<Tiles, 16>(which_dist_hash, rand_seed);
+		zobrist.reset(new Zobrist<Tiles, 16>(which_dist_hash, rand_seed));
+		dist_h = zobrist.get();
 	}
 
 	unsigned int dist_hash(const State &s) const {
 		return dist_h->dist_h(s);
 	}
 
+	std::vector<unsigned int> ops(const State &s) const {
+		std::vector<unsigned int> ret(optab[(int) s.blank].ops,
+				optab[(int) s.blank].ops + optab[(int) s.blank].n);
+		return ret;
+	}
+
+	// Packed successor generation (PACKED_EXPANSION in hdastar.hpp).
+	// Tile i is the nibble at bit (Ntiles - 1 - i) * 4 of the word and
+	// the blank nibble is always 0, so moving a tile into the blank is
+	// two XORs. The caller carries the blank position, h and the
+	// Zobrist value, which are updated incrementally.
+	int nops_packed(int blank) const {
+		return optab[blank].n;
+	}
+
+	int nthop_packed(int blank, int n) const {
+		return optab[blank].ops[n];
+	}
+
+	int packed_tile(const PackedState &p, int i) const {
+		return (p.word >> ((Ntiles - 1 - i) * 4)) & 0xF;
+	}
+
+	// apply_packed moves the tile at newb into the blank. h and zbr
+	// are the values of the parent on entry and of the child on return.
+	PackedState apply_packed(const PackedState &p, int blank, int newb,
+			int &h, unsigned int &zbr) const {
+		uint64_t tile = packed_tile(p, newb);
+		PackedState c;
+		c.word = p.word ^ (tile << ((Ntiles - 1 - newb) * 4))
+				^ (tile << ((Ntiles - 1 - blank) * 4));
+		switch (which_heuristic) {
+		case 0:
+			h += mdincr[tile][newb][blank];
+			break;
+		case 1:
+			h = packed_displacement(c);
+			break;
+		case 2:
+			h = 0;
+			break;
+		case 3:
+			h += mdincr[tile][newb][blank] + lconflict_packed(c.word, newb, blank)
+					- lconflict_packed(p.word, newb, blank);
+			break;
+		}
+		zbr = zobrist->inc_hash(zbr, tile, newb, blank);
+		return c;
+	}
+
+	bool isgoal_packed(const PackedState &p) const {
+		return p.word == 0x0123456789ABCDEFULL;
+	}
+
 private:
 
 // mdist returns the Manhattan distance of the given tile array.
+// tiles[blank] must be 0.
 	int mdist(int blank, char tiles[]) const {
-		int sum = 0;
-		for (int i = 0; i < Ntiles; i++) {
-			if (i == blank)
-				continue;
-			int row = i / Width, col = i % Width;
-			int grow = tiles[i] / Width, gcol = tiles[i] % Width;
-			sum += abs(gcol - col) + abs(grow - row);
-		}
-		return sum;
+		return kernels->manhattan16(tiles);
 	}
 
 // Given a state tiles[], return a mdist to the init state.
@@ -349,6 +437,74 @@ private:
 
 	int which_heuristic;
 
+// Linear conflict (which_heuristic 3). Two tiles in their goal row
+// (column) are in conflict if they are in the wrong order; each tile
+// that has to leave the line to resolve the conflicts adds 2 moves
+// to the Manhattan distance. lcrow[r][key] and lccol[c][key] are the
+// conflicts of row r and column c, where the key is the four tiles of
+// the line as nibbles, first position in the top nibble.
+	static unsigned char lcrow[Width][1 << (4 * Width)];
+	static unsigned char lccol[Height][1 << (4 * Height)];
+
+	int rowkey(const char tiles[], int r) const {
+		const char *t = tiles + r * Width;
+		return (t[0] << 12) | (t[1] << 8) | (t[2] << 4) | t[3];
+	}
+
+	int colkey(const char tiles[], int c) const {
+		return (tiles[c] << 12) | (tiles[c + Width] << 8)
+				| (tiles[c + 2 * Width] << 4) | tiles[c + 3 * Width];
+	}
+
+// lconflict returns the linear conflict of the whole board.
+// tiles[blank] must be 0.
+	int lconflict(const char tiles[]) const {
+		int sum = 0;
+		for (int i = 0; i < Width; ++i)
+			sum += lcrow[i][rowkey(tiles, i)] + lccol[i][colkey(tiles, i)];
+		return sum;
+	}
+
+// lconflict returns the conflicts of the two lines that change when
+// the tile moves between a and b: the columns of a horizontal move,
+// the rows of a vertical one.
+	int lconflict(const char tiles[], int a, int b) const {
+		if (a / Width == b / Width)
+			return lccol[a % Width][colkey(tiles, a % Width)]
+					+ lccol[b % Width][colkey(tiles, b % Width)];
+		return lcrow[a / Width][rowkey(tiles, a / Width)]
+				+ lcrow[b / Width][rowkey(tiles, b / Width)];
+	}
+
+	int lconflict_packed(uint64_t word, int a, int b) const {
+		if (a / Width == b / Width) {
+			int sum = 0;
+			for (int j = 0; j < 2; ++j) {
+				int c = (j == 0 ? a : b) % Width;
+				uint64_t x = word >> ((Width - 1 - c) * 4);
+				int key = ((x >> 48) & 0xF) << 12 | ((x >> 32) & 0xF) << 8
+						| ((x >> 16) & 0xF) << 4 | (x & 0xF);
+				sum += lccol[c][key];
+			}
+			return sum;
+		}
+		return lcrow[a / Width][(word >> ((Height - 1 - a / Width) * 16)) & 0xFFFF]
+				+ lcrow[b / Width][(word >> ((Height - 1 - b / Width) * 16)) & 0xFFFF];
+	}
+
+// initlc initializes the linear conflict tables.
+	static void initlc();
+
+// packed_displacement counts the positions 1..15 whose nibble differs
+// from the goal, as displacement() does on an unpacked state.
+	int packed_displacement(const PackedState &p) const {
+		uint64_t x = p.word ^ 0x0123456789ABCDEFULL;
+		x |= x >> 1;
+		x |= x >> 2;
+		x &= 0x0111111111111111ULL; // position 0 is the top nibble
+		return __builtin_popcountll(x);
+	}
+
 // initmd initializes the md and mdincr tables.
 	void initmd();
 
@@ -375,6 +531,10 @@ private:
 	int which_dist_hash;
 	DistributionHash<Tiles>* dist_h;
 
+// kernels are the board kernels picked for this CPU.
+	const TilesKernels *kernels;
+	std::shared_ptr<Zobrist<Tiles, 16> > zobrist; // shared by copies
+
 // optab is indexed by the blank position.  Each
 // entry is a description of the possible next
 // blank positions.
@@ -4,6 +4,7 @@
 #include "tiles24.hpp"
 #include <string>
 #include <cstdio>
+#include <cstring>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -42,6 +43,7 @@ Tiles24::Tiles24(FILE *in) {
 
 //	initmd();
 	initoptab();
+	kernels = &tiles_kernels();
 }
 
 /**
@@ -64,40 +66,41 @@ Tiles24::Tiles24(FILE *in, int line) {
 	initoptab();
 
 	// Here read pattern database from the file.
+	// The tables are static, so later instances reuse them.
+	if (!pdb_loaded) {
+		if (access("pat24.1256712.tab", F_OK) == -1) {
+			printf("no pat24.1256712.tab file\n");
+		}
+		if (access("pat24.34891314.tab", F_OK) == -1) {
+			printf("no pat24.34891314.tab file\n");
+		}
 
-	if (access("pat24.1256712.tab", F_OK) == -1) {
-		printf("no pat24.1256712.tab file\n");
+		FILE* infile;
+		infile = fopen("pat24.1256712.tab", "rb");
+		//	infile = fopen("pat24.156101112.tab", "rb");
+		//	infile = fopen("pat24.34891314.tab", "rb");
+		readfile(h0, infile);
+		fclose(infile);
+		printf("pattern 1 2 5 6 7 12 read in\n");
+		//	printf("pattern 1 5 6 10 11 12 read in\n");
+
+		infile = fopen("pat24.34891314.tab", "rb");
+		//	infile = fopen("pat24.234789.tab", "rb");
+		//	infile = fopen("pat24.1256712.tab", "rb");
+		readfile(h1, infile);
+		fclose(infile);
+		printf("pattern 3 4 8 9 13 14 read in\n");
+		//	printf("pattern 2 3 4 7 8 9 read in\n");
+		pdb_loaded = true;
 	}
-	if (access("pat24.34891314.tab", F_OK) == -1) {
-		printf("no pat24.34891314.tab file\n");
-	}
-
-
-	FILE* infile;
-	infile = fopen("pat24.1256712.tab", "rb");
-//	infile = fopen("pat24.156101112.tab", "rb");
-//	infile = fopen("pat24.34891314.tab", "rb");
-	readfile(h0, infile);
-	fclose(infile);
-	printf("pattern 1 2 5 6 7 12 read in\n");
-//	printf("pattern 1 5 6 10 11 12 read in\n");
-
-	infile = fopen("pat24.34891314.tab", "rb");
-//	infile = fopen("pat24.234789.tab", "rb");
-//	infile = fopen("pat24.1256712.tab", "rb");
-	readfile(h1, infile);
-	fclose(infile);
-	printf("pattern 3 4 8 9 13 14 read in\n");
-//	printf("pattern 2 3 4 7 8 9 read in\n");
-
 
-	closed_hash_tbl.resize(Ntiles);
+	memset(closed_hash_tbl, 0, sizeof closed_hash_tbl);
 	for (int i = 0; i < Ntiles; ++i) {
-		closed_hash_tbl[i].resize(Ntiles);
 		for (int j = 0; j < Ntiles; ++j) {
-			closed_hash_tbl[i][j] = random();
+			closed_hash_tbl[i * 32 + j] = random();
 		}
 	}
+	kernels = &tiles_kernels();
 }
 
 void Tiles24::initoptab() {
@@ -117,6 +120,7 @@ void Tiles24::initoptab() {
 
 unsigned char Tiles24::h0[TABLESIZE]; /* heuristic tables for pattern databases */
 unsigned char Tiles24::h1[TABLESIZE];
+bool Tiles24::pdb_loaded = false;
 
 // Read pattern database files and store them up to the array.
 void Tiles24::readfile(unsigned char table[TABLESIZE], FILE* infile) {
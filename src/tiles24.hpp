@@ -6,9 +6,12 @@
 #include "hashtbl.hpp"
 #include "zobrist.hpp"
 #include "dist_hash.hpp"
+#include "tiles_simd.hpp"
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <cstring>
+#include <memory>
 
 // Exact Table size for 24 puzzle's pattern databases.
 #define TABLESIZE 244140625
@@ -59,6 +62,18 @@ struct Tiles24 {
 			}
 			hash_key = (uint64_t) word;
 		}
+
+		// Host byte order, for mpi/wire_format.hpp.
+		static const unsigned int wire_bytes = 16;
+
+		void to_wire(unsigned char* d) const {
+			memcpy(d, &word, 16);
+		}
+
+		void from_wire(const unsigned char* d) {
+			memcpy(&word, d, 16);
+			hash_key = (uint64_t) word;
+		}
 	};
 
 	// Tiles constructs a new instance by reading
@@ -170,29 +185,15 @@ struct Tiles24 {
 	// pack packes state s into the packed state dst.
 	// TODO: Not memory efficient but time efficient. May need to reconsider as its the memory that matters.
 	void pack(PackedState &dst, State &s) const {
-		dst.word = 0; // to make g++ shut up about uninitialized usage.
 		s.tiles[(int) s.blank] = 0;
-		for (int i = 0; i < Ntiles; i++)
-			dst.word = (dst.word << 5) | s.tiles[i];
-
-		dst.hash_key = 0;
-		for (int i = 0; i < Ntiles; i++) {
-			dst.hash_key = dst.hash_key ^ closed_hash_tbl[i][s.tiles[i]];
-		}
-
+		dst.word = kernels->pack25(s.tiles);
+		dst.hash_key = kernels->xor_hash25(s.tiles, closed_hash_tbl);
 		dst.h = s.h;
 	}
 
 	// unpack unpacks the packed state s into the state dst.
 	void unpack(State &dst, PackedState s) const {
-		dst.blank = -1;
-		for (int i = Ntiles - 1; i >= 0; i--) {
-			int t = s.word & 0x1F;
-			s.word >>= 5;
-			dst.tiles[i] = t;
-			if (t == 0)
-				dst.blank = i;
-		}
+		dst.blank = kernels->unpack25(s.word, dst.tiles);
 		dst.h = heuristic(dst.tiles);
 		assert(dst.blank >= 0);
 	}
@@ -224,22 +225,76 @@ struct Tiles24 {
 
 	void set_dist_hash(int h, int rand_seed = 0) {
 		which_dist_hash = h;
-		dist_h = new Zobrist<Tiles24, 25>(which_dist_hash, rand_seed);
+		zobrist.reset(new Zobrist<Tiles24, 25>(which_dist_hash, rand_seed));
+		dist_h = zobrist.get();
 	}
 
 	unsigned int dist_hash(const State &s) const {
 		return dist_h->dist_h(s);
 	}
 
+	std::vector<unsigned int> ops(const State &s) const {
+		std::vector<unsigned int> ret(optab[(int) s.blank].ops,
+				optab[(int) s.blank].ops + optab[(int) s.blank].n);
+		return ret;
+	}
+
+	// Batched heuristic evaluation (BATCH_EXPANSION in hdastar.hpp).
+	// A pattern database lookup is a random access into the 244 MB
+	// tables, so evaluating children one at a time pays a memory miss
+	// for every lookup. apply_lazy moves the blank without computing h,
+	// and heuristic_batch computes all the table indices of n states,
+	// prefetches them and only then reads the values.
+	Edge<Tiles24> apply_lazy(State &s, int newb) const {
+		Edge<Tiles24> e(1, newb, s.blank);
+		e.undo.h = s.h;
+		e.undo.blank = s.blank;
+
+		s.tiles[(int) s.blank] = s.tiles[newb];
+		s.tiles[newb] = 0;
+		s.blank = newb;
+		return e;
+	}
+
+	void heuristic_batch(State *s, unsigned int n) const {
+		if (hfunction != 0) {
+			for (unsigned int i = 0; i < n; ++i) {
+				s[i].h = heuristic(s[i].tiles);
+			}
+			return;
+		}
+		// In chunks on the stack: 8 lookups a state already outnumber the
+		// misses a core keeps in flight.
+		PdbIndex idx[BatchChunk];
+		for (unsigned int c = 0; c < n; c += BatchChunk) {
+			unsigned int m = n - c;
+			if (m > BatchChunk)
+				m = BatchChunk;
+			for (unsigned int i = 0; i < m; ++i) {
+				pdb_index(s[c + i].tiles, idx[i]);
+				pdb_prefetch(idx[i]);
+			}
+			for (unsigned int i = 0; i < m; ++i) {
+				s[c + i].h = pdb_gather(idx[i]);
+			}
+		}
+	}
+
 
 private:
 
-	std::vector<std::vector<unsigned int> > closed_hash_tbl;
+	// closed_hash_tbl[i * 32 + t] is the random key of tile t at
+	// position i. Rows and columns are padded to 32 for the kernels.
+	unsigned int closed_hash_tbl[32 * 32];
+
+	// kernels are the board kernels picked for this CPU.
+	const TilesKernels *kernels;
 
 	unsigned int hfunction = 0;
 
 	int which_dist_hash;
 	DistributionHash<Tiles24>* dist_h;
+	std::shared_ptr<Zobrist<Tiles24, 25> > zobrist; // shared by copies
 
 
 //	// mdist returns the Manhattan distance of the given tile array.
@@ -286,10 +341,7 @@ private:
 		char inv[Ntiles];
 
 		// TODO: is this interpretation right?
-		for (int i = 0; i < Ntiles; ++i) {
-			inv[tiles[i]] = i;
-			//			inv[i] = tiles[i];
-		}
+		kernels->inverse25(tiles, inv);
 
 		unsigned int origin = hash0(inv) + hash1(inv) + hash2(inv) + hash3(inv);
 		unsigned int reflection = hashref0(inv) + hashref1(inv) + hashref2(inv)
@@ -317,80 +369,121 @@ private:
 		//		return origin;
 	}
 
-	unsigned int manhattan(char tiles[]) const {
-		int sum = 0;
-		for (int i = 0; i < Ntiles; i++) {
-			if (tiles[i] == 0) {
-				continue;
-			}
-			int row = i / Width, col = i % Width;
-			int grow = tiles[i] / Width, gcol = tiles[i] % Width;
-			sum += abs(gcol - col) + abs(grow - row);
+	static const unsigned int BatchChunk = 32;
+
+	// PdbIndex holds the indices of the four patterns and their
+	// reflections into h0 and h1, in the order summed by pdb().
+	struct PdbIndex {
+		unsigned int origin[4];
+		unsigned int reflection[4];
+	};
+
+	void pdb_index(char tiles[], PdbIndex &p) const {
+		char inv[Ntiles];
+		kernels->inverse25(tiles, inv);
+		p.origin[0] = index0(inv);
+		p.origin[1] = index1(inv);
+		p.origin[2] = index2(inv);
+		p.origin[3] = index3(inv);
+		p.reflection[0] = indexref0(inv);
+		p.reflection[1] = indexref1(inv);
+		p.reflection[2] = indexref2(inv);
+		p.reflection[3] = indexref3(inv);
+	}
+
+	void pdb_prefetch(const PdbIndex &p) const {
+		__builtin_prefetch(&h0[p.origin[0]]);
+		__builtin_prefetch(&h0[p.reflection[0]]);
+		for (int i = 1; i < 4; ++i) {
+			__builtin_prefetch(&h1[p.origin[i]]);
+			__builtin_prefetch(&h1[p.reflection[i]]);
 		}
-		return sum;
+	}
+
+	unsigned int pdb_gather(const PdbIndex &p) const {
+		unsigned int origin = h0[p.origin[0]] + h1[p.origin[1]]
+				+ h1[p.origin[2]] + h1[p.origin[3]];
+		unsigned int reflection = h0[p.reflection[0]] + h1[p.reflection[1]]
+				+ h1[p.reflection[2]] + h1[p.reflection[3]];
+		return max(origin, reflection);
+	}
+
+	unsigned int manhattan(char tiles[]) const {
+		return kernels->manhattan25(tiles);
 	}
 
 	/* HASH0 takes an inverse state, and maps the tiles in the 0 pattern to an
 	 integer that represents those tile positions uniquely.  It then returns the
 	 actual heuristic value from the pattern database. */
 	unsigned int hash0(char inv[]) const {
-		int hashval = ((((inv[1] * Ntiles + inv[2]) * Ntiles + inv[5]) * Ntiles
-				+ inv[6]) * Ntiles + inv[7]) * Ntiles + inv[12];
-		return (h0[hashval]);
+		return (h0[index0(inv)]);
 	} /* total moves for this pattern */
 	unsigned int hashref0(char inv[]) const {
-		/* index into heuristic table */
-		int hashval = (((((ref[inv[5]] * Ntiles + ref[inv[10]]) * Ntiles
-				+ ref[inv[1]]) * Ntiles + ref[inv[6]]) * Ntiles + ref[inv[11]])
-				* Ntiles + ref[inv[12]]);
-		return (h0[hashval]);
+		return (h0[indexref0(inv)]);
 	} /* total moves for this pattern */
-
 	unsigned int hash1(char inv[]) const {
-		/* index into heuristic table */
-		int hashval = ((((inv[3] * Ntiles + inv[4]) * Ntiles + inv[8]) * Ntiles
-				+ inv[9]) * Ntiles + inv[13]) * Ntiles + inv[14];
-		return (h1[hashval]);
+		return (h1[index1(inv)]);
 	} /* total moves for this pattern */
 	unsigned int hashref1(char inv[]) const {
-		/* index into heuristic table */
-		int hashval =
-				(((((ref[inv[15]] * Ntiles + ref[inv[20]]) * Ntiles
-						+ ref[inv[16]]) * Ntiles + ref[inv[21]]) * Ntiles
-						+ ref[inv[17]]) * Ntiles + ref[inv[22]]);
-		return (h1[hashval]);
+		return (h1[indexref1(inv)]);
 	} /* total moves for this pattern */
 	unsigned int hash2(char inv[]) const {
-		/* index into heuristic table */
-		int hashval = ((((rot180[inv[21]] * Ntiles + rot180[inv[20]]) * Ntiles
-				+ rot180[inv[16]]) * Ntiles + rot180[inv[15]]) * Ntiles
-				+ rot180[inv[11]]) * Ntiles + rot180[inv[10]];
-		return (h1[hashval]);
+		return (h1[index2(inv)]);
 	} /* total moves for this pattern */
 	unsigned int hashref2(char inv[]) const {
-		/* index into heuristic table */
-		int hashval = (((((rot180ref[inv[9]] * Ntiles + rot180ref[inv[4]])
-				* Ntiles + rot180ref[inv[8]]) * Ntiles + rot180ref[inv[3]])
-				* Ntiles + rot180ref[inv[7]]) * Ntiles + rot180ref[inv[2]]);
-		return (h1[hashval]);
+		return (h1[indexref2(inv)]);
 	} /* total moves for this pattern */
 	unsigned int hash3(char inv[]) const {
-		/* index into heuristic table */
-		int hashval = ((((rot90[inv[19]] * Ntiles + rot90[inv[24]]) * Ntiles
-				+ rot90[inv[18]]) * Ntiles + rot90[inv[23]]) * Ntiles
-				+ rot90[inv[17]]) * Ntiles + rot90[inv[22]];
-		return (h1[hashval]);
+		return (h1[index3(inv)]);
 	} /* total moves for this pattern */
 	unsigned int hashref3(char inv[]) const {
-		/* index into heuristic table */
-		int hashval = (((((rot90ref[inv[23]] * Ntiles + rot90ref[inv[24]])
+		return (h1[indexref3(inv)]);
+	} /* total moves for this pattern */
+
+	/* INDEX0 takes an inverse state and returns the index into the
+	 pattern database for the tiles in the 0 pattern. */
+	unsigned int index0(char inv[]) const {
+		return ((((inv[1] * Ntiles + inv[2]) * Ntiles + inv[5]) * Ntiles
+				+ inv[6]) * Ntiles + inv[7]) * Ntiles + inv[12];
+	}
+	unsigned int indexref0(char inv[]) const {
+		return (((((ref[inv[5]] * Ntiles + ref[inv[10]]) * Ntiles
+				+ ref[inv[1]]) * Ntiles + ref[inv[6]]) * Ntiles + ref[inv[11]])
+				* Ntiles + ref[inv[12]]);
+	}
+	unsigned int index1(char inv[]) const {
+		return ((((inv[3] * Ntiles + inv[4]) * Ntiles + inv[8]) * Ntiles
+				+ inv[9]) * Ntiles + inv[13]) * Ntiles + inv[14];
+	}
+	unsigned int indexref1(char inv[]) const {
+		return (((((ref[inv[15]] * Ntiles + ref[inv[20]]) * Ntiles
+				+ ref[inv[16]]) * Ntiles + ref[inv[21]]) * Ntiles
+				+ ref[inv[17]]) * Ntiles + ref[inv[22]]);
+	}
+	unsigned int index2(char inv[]) const {
+		return ((((rot180[inv[21]] * Ntiles + rot180[inv[20]]) * Ntiles
+				+ rot180[inv[16]]) * Ntiles + rot180[inv[15]]) * Ntiles
+				+ rot180[inv[11]]) * Ntiles + rot180[inv[10]];
+	}
+	unsigned int indexref2(char inv[]) const {
+		return (((((rot180ref[inv[9]] * Ntiles + rot180ref[inv[4]])
+				* Ntiles + rot180ref[inv[8]]) * Ntiles + rot180ref[inv[3]])
+				* Ntiles + rot180ref[inv[7]]) * Ntiles + rot180ref[inv[2]]);
+	}
+	unsigned int index3(char inv[]) const {
+		return ((((rot90[inv[19]] * Ntiles + rot90[inv[24]]) * Ntiles
+				+ rot90[inv[18]]) * Ntiles + rot90[inv[23]]) * Ntiles
+				+ rot90[inv[17]]) * Ntiles + rot90[inv[22]];
+	}
+	unsigned int indexref3(char inv[]) const {
+		return (((((rot90ref[inv[23]] * Ntiles + rot90ref[inv[24]])
 				* Ntiles + rot90ref[inv[18]]) * Ntiles + rot90ref[inv[19]])
 				* Ntiles + rot90ref[inv[13]]) * Ntiles + rot90ref[inv[14]]);
-		return (h1[hashval]);
-	} /* total moves for this pattern */
+	}
 	// Pattern Databases Heuristics
 	static unsigned char h0[TABLESIZE]; /* heuristic tables for pattern databases */
 	static unsigned char h1[TABLESIZE];
+	static bool pdb_loaded; // h0 and h1 are read once per process.
 	/* the pattern that each tile is in */
 	int whichpat[Ntiles] = { 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 2, 2, 0, 1, 1, 2, 2,
 			3, 3, 3, 2, 2, 3, 3, 3 };
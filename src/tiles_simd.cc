@@ -0,0 +1,417 @@
+/*
+ * tiles_simd.cc
+ *
+ * Scalar, SSE and AVX2 versions of the kernels in tiles_simd.hpp.
+ * The vector versions are compiled with target attributes and only
+ * called after the CPU was checked with __builtin_cpu_supports.
+ */
+
+#include "tiles_simd.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+
+///////////////////////////////////////////////////////////////////////
+// Scalar
+///////////////////////////////////////////////////////////////////////
+
+static uint64_t pack16_scalar(const char tiles[16]) {
+	uint64_t word = 0;
+	for (int i = 0; i < 16; ++i)
+		word = (word << 4) | tiles[i];
+	return word;
+}
+
+static int unpack16_scalar(uint64_t word, char tiles[16]) {
+	int blank = -1;
+	for (int i = 15; i >= 0; --i) {
+		tiles[i] = word & 0xF;
+		word >>= 4;
+		if (tiles[i] == 0)
+			blank = i;
+	}
+	return blank;
+}
+
+static unsigned int manhattan16_scalar(const char tiles[16]) {
+	unsigned int sum = 0;
+	for (int i = 0; i < 16; ++i) {
+		int t = tiles[i];
+		if (t == 0)
+			continue;
+		sum += abs(t / 4 - i / 4) + abs(t % 4 - i % 4);
+	}
+	return sum;
+}
+
+static uint128_t pack25_scalar(const char tiles[25]) {
+	uint128_t word = 0;
+	for (int i = 0; i < 25; ++i)
+		word = (word << 5) | tiles[i];
+	return word;
+}
+
+static int unpack25_scalar(uint128_t word, char tiles[25]) {
+	int blank = -1;
+	for (int i = 24; i >= 0; --i) {
+		tiles[i] = word & 0x1F;
+		word >>= 5;
+		if (tiles[i] == 0)
+			blank = i;
+	}
+	return blank;
+}
+
+static unsigned int manhattan25_scalar(const char tiles[25]) {
+	unsigned int sum = 0;
+	for (int i = 0; i < 25; ++i) {
+		int t = tiles[i];
+		if (t == 0)
+			continue;
+		sum += abs(t / 5 - i / 5) + abs(t % 5 - i % 5);
+	}
+	return sum;
+}
+
+static void inverse25_scalar(const char tiles[25], char inv[25]) {
+	for (int i = 0; i < 25; ++i)
+		inv[(int) tiles[i]] = i;
+}
+
+static uint64_t xor_hash25_scalar(const char tiles[25],
+		const unsigned int *tbl) {
+	uint64_t h = 0;
+	for (int i = 0; i < 25; ++i)
+		h ^= tbl[i * 32 + tiles[i]];
+	return h;
+}
+
+///////////////////////////////////////////////////////////////////////
+// SSE (SSSE3 + SSE4.1)
+///////////////////////////////////////////////////////////////////////
+
+#define SSE_TARGET __attribute__((target("ssse3,sse4.1")))
+
+// Row and column of each position of the 4x4 board.
+static const char row16[16] = { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3,
+		3 };
+static const char col16[16] = { 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2,
+		3 };
+
+// Row and column of each position of the 5x5 board, padded to 32.
+static const char row25[32] = { 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2,
+		3, 3, 3, 3, 3, 4, 4, 4, 4, 4 };
+static const char col25[32] = { 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4,
+		0, 1, 2, 3, 4, 0, 1, 2, 3, 4 };
+
+// For each tile of a 5x5 board, the two bytes of the little-endian
+// packed word holding its 5 bits, and the multiplier that moves the
+// bits to the top of the 16-bit lane (see unpack25_sse).
+static const char unpack25_bytes[64] = { 15, -128, 14, 15, 13, 14, 13, 14, 12,
+		13, 11, 12, 11, 12, 10, 11, 10, 11, 9, 10, 8, 9, 8, 9, 7, 8, 6, 7, 6, 7,
+		5, 6, 5, 6, 4, 5, 3, 4, 3, 4, 2, 3, 1, 2, 1, 2, 0, 1, 0, 1, -128, -128,
+		-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128 };
+static const short unpack25_mul[32] = { 2048, 256, 32, 1024, 128, 16, 512, 64,
+		2048, 256, 32, 1024, 128, 16, 512, 64, 2048, 256, 32, 1024, 128, 16,
+		512, 64, 2048 };
+
+// load25_sse loads positions 0..15 into lo and 16..24 into the low
+// bytes of hi, zero filled. The second load starts at position 9 so
+// that nothing past the board is read, and going through memory is
+// avoided as a 32-byte load of a freshly copied buffer stalls on
+// store forwarding.
+static SSE_TARGET void load25_sse(const char tiles[25], __m128i &lo,
+		__m128i &hi) {
+	lo = _mm_loadu_si128((const __m128i *) tiles);
+	hi = _mm_srli_si128(_mm_loadu_si128((const __m128i *) (tiles + 9)), 7);
+}
+
+// store25_sse is the inverse of load25_sse.
+static SSE_TARGET void store25_sse(char tiles[25], __m128i lo, __m128i hi) {
+	_mm_storeu_si128((__m128i *) tiles, lo);
+	_mm_storeu_si128((__m128i *) (tiles + 9), _mm_alignr_epi8(hi, lo, 9));
+}
+
+// Pairs of tiles are merged by maddubs (t0 * 16 + t1) and narrowed to bytes.
+static SSE_TARGET uint64_t pack16_sse(const char tiles[16]) {
+	__m128i v = _mm_loadu_si128((const __m128i *) tiles);
+	__m128i pairs = _mm_maddubs_epi16(v, _mm_set1_epi16(0x0110));
+	__m128i bytes = _mm_packus_epi16(pairs, pairs);
+	return __builtin_bswap64(_mm_cvtsi128_si64(bytes));
+}
+
+static SSE_TARGET int unpack16_sse(uint64_t word, char tiles[16]) {
+	__m128i v = _mm_cvtsi64_si128(__builtin_bswap64(word));
+	__m128i mask = _mm_set1_epi8(0x0F);
+	__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+	__m128i lo = _mm_and_si128(v, mask);
+	__m128i t = _mm_unpacklo_epi8(hi, lo);
+	_mm_storeu_si128((__m128i *) tiles, t);
+	return __builtin_ctz(
+			_mm_movemask_epi8(_mm_cmpeq_epi8(t, _mm_setzero_si128())));
+}
+
+// Sum of |a - b| over the rows and the columns with psadbw. The blank
+// lanes take the coordinates of their position so that they add 0.
+static SSE_TARGET unsigned int manhattan16_sse(const char tiles[16]) {
+	__m128i v = _mm_loadu_si128((const __m128i *) tiles);
+	__m128i three = _mm_set1_epi8(3);
+	__m128i rp = _mm_loadu_si128((const __m128i *) row16);
+	__m128i cp = _mm_loadu_si128((const __m128i *) col16);
+	__m128i blank = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+	__m128i rt = _mm_blendv_epi8(_mm_and_si128(_mm_srli_epi16(v, 2), three),
+			rp, blank);
+	__m128i ct = _mm_blendv_epi8(_mm_and_si128(v, three), cp, blank);
+	__m128i s = _mm_add_epi64(_mm_sad_epu8(rt, rp), _mm_sad_epu8(ct, cp));
+	return _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+}
+
+// Tiles 4k..4k+3 are merged into one 20-bit lane by maddubs and madd.
+static SSE_TARGET uint128_t pack25_sse(const char tiles[25]) {
+	__m128i v0, v1;
+	load25_sse(tiles, v0, v1);
+	__m128i pair = _mm_set1_epi16(0x0120); // t0 * 32 + t1
+	__m128i quad = _mm_set1_epi32(0x00010400); // p0 * 1024 + p1
+	__m128i a = _mm_madd_epi16(_mm_maddubs_epi16(v0, pair), quad);
+	__m128i b = _mm_madd_epi16(_mm_maddubs_epi16(v1, pair), quad);
+	uint128_t hi = ((uint128_t) _mm_extract_epi32(a, 0) << 60)
+			| ((uint128_t) _mm_extract_epi32(a, 1) << 40)
+			| ((uint128_t) _mm_extract_epi32(a, 2) << 20)
+			| (uint128_t) _mm_extract_epi32(a, 3);
+	uint128_t lo = ((uint128_t) _mm_extract_epi32(b, 0) << 60)
+			| ((uint128_t) _mm_extract_epi32(b, 1) << 40)
+			| ((uint128_t) _mm_extract_epi32(b, 2) << 20)
+			| (uint128_t) _mm_extract_epi32(b, 3);
+	// 32 tiles make 160 bits; the 7 padding tiles are the low 35.
+	return (hi << 45) | (lo >> 35);
+}
+
+// Each tile is gathered into a 16-bit lane by pshufb, shifted to the
+// top of the lane by a multiply and shifted down by 11.
+static SSE_TARGET int unpack25_sse(uint128_t word, char tiles[25]) {
+	__m128i w = _mm_loadu_si128((const __m128i *) &word);
+	__m128i r[4];
+	for (int i = 0; i < 4; ++i) {
+		__m128i lanes = _mm_shuffle_epi8(w,
+				_mm_loadu_si128((const __m128i *) (unpack25_bytes + 16 * i)));
+		__m128i mul = _mm_loadu_si128((const __m128i *) (unpack25_mul + 8 * i));
+		r[i] = _mm_srli_epi16(_mm_mullo_epi16(lanes, mul), 11);
+	}
+	__m128i t0 = _mm_packus_epi16(r[0], r[1]);
+	__m128i t1 = _mm_packus_epi16(r[2], r[3]);
+	store25_sse(tiles, t0, t1);
+	__m128i zero = _mm_setzero_si128();
+	unsigned int blank = _mm_movemask_epi8(_mm_cmpeq_epi8(t0, zero))
+			| (_mm_movemask_epi8(_mm_cmpeq_epi8(t1, zero)) << 16);
+	return __builtin_ctz(blank);
+}
+
+// Row and column of tiles 0..24 by table lookup. pshufb only indexes
+// 16 entries, so tiles 16..24 come from a second table; adding 0x70
+// with saturation sets the top bit of tiles >= 16, which makes the
+// first lookup return 0, and subtracting 16 does the same for the
+// second lookup on tiles < 16.
+static SSE_TARGET __m128i lookup25_sse(__m128i v, const char tbl[32]) {
+	__m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) tbl),
+			_mm_adds_epu8(v, _mm_set1_epi8(0x70)));
+	__m128i hi = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *) (tbl + 16)),
+			_mm_sub_epi8(v, _mm_set1_epi8(16)));
+	return _mm_or_si128(lo, hi);
+}
+
+static SSE_TARGET unsigned int manhattan25_sse(const char tiles[25]) {
+	__m128i half[2];
+	load25_sse(tiles, half[0], half[1]);
+	__m128i s = _mm_setzero_si128();
+	for (int i = 0; i < 32; i += 16) {
+		__m128i v = half[i / 16];
+		__m128i rp = _mm_loadu_si128((const __m128i *) (row25 + i));
+		__m128i cp = _mm_loadu_si128((const __m128i *) (col25 + i));
+		__m128i blank = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+		__m128i rt = _mm_blendv_epi8(lookup25_sse(v, row25), rp, blank);
+		__m128i ct = _mm_blendv_epi8(lookup25_sse(v, col25), cp, blank);
+		s = _mm_add_epi64(s, _mm_sad_epu8(rt, rp));
+		s = _mm_add_epi64(s, _mm_sad_epu8(ct, cp));
+	}
+	return _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+}
+
+///////////////////////////////////////////////////////////////////////
+// AVX2 + BMI2
+///////////////////////////////////////////////////////////////////////
+
+#define AVX2_TARGET __attribute__((target("avx2,bmi2")))
+
+static inline uint64_t load64(const char *p) {
+	uint64_t x;
+	memcpy(&x, p, sizeof x);
+	return x;
+}
+
+// pext gathers the low bits of 8 bytes; the byte swap puts the first
+// tile in the most significant bits.
+static AVX2_TARGET uint64_t pack16_avx2(const char tiles[16]) {
+	const uint64_t m = 0x0F0F0F0F0F0F0F0FULL;
+	return (_pext_u64(__builtin_bswap64(load64(tiles)), m) << 32)
+			| _pext_u64(__builtin_bswap64(load64(tiles + 8)), m);
+}
+
+static AVX2_TARGET int unpack16_avx2(uint64_t word, char tiles[16]) {
+	const uint64_t m = 0x0F0F0F0F0F0F0F0FULL;
+	uint64_t a = __builtin_bswap64(_pdep_u64(word >> 32, m));
+	uint64_t b = __builtin_bswap64(_pdep_u64(word, m));
+	__m128i t = _mm_set_epi64x(b, a);
+	_mm_storeu_si128((__m128i *) tiles, t);
+	return __builtin_ctz(
+			_mm_movemask_epi8(_mm_cmpeq_epi8(t, _mm_setzero_si128())));
+}
+
+static AVX2_TARGET uint128_t pack25_avx2(const char tiles[25]) {
+	const uint64_t m = 0x1F1F1F1F1F1F1F1FULL;
+	uint128_t c0 = _pext_u64(__builtin_bswap64(load64(tiles)), m);
+	uint128_t c1 = _pext_u64(__builtin_bswap64(load64(tiles + 8)), m);
+	uint128_t c2 = _pext_u64(__builtin_bswap64(load64(tiles + 16)), m);
+	return (c0 << 85) | (c1 << 45) | (c2 << 5) | (uint128_t) tiles[24];
+}
+
+static AVX2_TARGET int unpack25_avx2(uint128_t word, char tiles[25]) {
+	const uint64_t m = 0x1F1F1F1F1F1F1F1FULL;
+	const uint64_t bits40 = (1ULL << 40) - 1;
+	uint64_t x0 = __builtin_bswap64(
+			_pdep_u64((uint64_t) (word >> 85) & bits40, m));
+	uint64_t x1 = __builtin_bswap64(
+			_pdep_u64((uint64_t) (word >> 45) & bits40, m));
+	uint64_t x2 = __builtin_bswap64(
+			_pdep_u64((uint64_t) (word >> 5) & bits40, m));
+	__m128i lo = _mm_set_epi64x(x1, x0);
+	__m128i hi = _mm_set_epi64x((uint64_t) word & 0x1F, x2);
+	store25_sse(tiles, lo, hi);
+	__m128i zero = _mm_setzero_si128();
+	unsigned int blank = _mm_movemask_epi8(_mm_cmpeq_epi8(lo, zero))
+			| (_mm_movemask_epi8(_mm_cmpeq_epi8(hi, zero)) << 16);
+	return __builtin_ctz(blank);
+}
+
+// load25_avx2 is load25_sse into the two lanes of one register.
+static AVX2_TARGET __m256i load25_avx2(const char tiles[25]) {
+	__m128i lo, hi;
+	load25_sse(tiles, lo, hi);
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+// As lookup25_sse, with the tables repeated in both 128-bit lanes.
+static AVX2_TARGET __m256i lookup25_avx2(__m256i v, const char tbl[32]) {
+	__m256i lo = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i *) tbl));
+	__m256i hi = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i *) (tbl + 16)));
+	return _mm256_or_si256(
+			_mm256_shuffle_epi8(lo, _mm256_adds_epu8(v, _mm256_set1_epi8(0x70))),
+			_mm256_shuffle_epi8(hi, _mm256_sub_epi8(v, _mm256_set1_epi8(16))));
+}
+
+static AVX2_TARGET unsigned int manhattan25_avx2(const char tiles[25]) {
+	__m256i v = load25_avx2(tiles);
+	__m256i rp = _mm256_loadu_si256((const __m256i *) row25);
+	__m256i cp = _mm256_loadu_si256((const __m256i *) col25);
+	__m256i blank = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+	__m256i rt = _mm256_blendv_epi8(lookup25_avx2(v, row25), rp, blank);
+	__m256i ct = _mm256_blendv_epi8(lookup25_avx2(v, col25), cp, blank);
+	__m256i s = _mm256_add_epi64(_mm256_sad_epu8(rt, rp),
+			_mm256_sad_epu8(ct, cp));
+	__m128i h = _mm_add_epi64(_mm256_castsi256_si128(s),
+			_mm256_extracti128_si256(s, 1));
+	return _mm_cvtsi128_si32(h) + _mm_extract_epi32(h, 2);
+}
+
+// inv[t] is the index of the first byte equal to t. The padding of the
+// high lane is 0 too, but it comes after the blank.
+static AVX2_TARGET void inverse25_avx2(const char tiles[25], char inv[25]) {
+	__m256i v = load25_avx2(tiles);
+	for (int t = 0; t < 25; ++t) {
+		unsigned int m = _mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(t)));
+		inv[t] = __builtin_ctz(m);
+	}
+}
+
+// Three 8-lane gathers of tbl[i * 32 + tiles[i]] for positions 0..23,
+// XORed together with the entry of position 24.
+static AVX2_TARGET uint64_t xor_hash25_avx2(const char tiles[25],
+		const unsigned int *tbl) {
+	__m128i lo, hi;
+	load25_sse(tiles, lo, hi);
+	__m256i pos = _mm256_setr_epi32(0, 32, 64, 96, 128, 160, 192, 224);
+	__m256i step = _mm256_set1_epi32(256);
+	__m128i bytes[3] = { lo, _mm_srli_si128(lo, 8), hi };
+	__m256i h = _mm256_setzero_si256();
+	for (int i = 0; i < 3; ++i) {
+		__m256i idx = _mm256_add_epi32(pos, _mm256_cvtepu8_epi32(bytes[i]));
+		h = _mm256_xor_si256(h,
+				_mm256_i32gather_epi32((const int *) tbl, idx, 4));
+		pos = _mm256_add_epi32(pos, step);
+	}
+	__m128i x = _mm_xor_si128(_mm256_castsi256_si128(h),
+			_mm256_extracti128_si256(h, 1));
+	x = _mm_xor_si128(x, _mm_shuffle_epi32(x, 0x4E));
+	x = _mm_xor_si128(x, _mm_shuffle_epi32(x, 0xB1));
+	return (unsigned int) _mm_cvtsi128_si32(x) ^ tbl[24 * 32 + tiles[24]];
+}
+
+///////////////////////////////////////////////////////////////////////
+// Selection
+///////////////////////////////////////////////////////////////////////
+
+static const TilesKernels scalar_kernels = { TilesKernels::SCALAR, "scalar",
+		pack16_scalar, unpack16_scalar, manhattan16_scalar, pack25_scalar,
+		unpack25_scalar, manhattan25_scalar, inverse25_scalar,
+		xor_hash25_scalar };
+
+// There is no gather before AVX2, so the SSE level hashes with the
+// scalar loop. Its inverse is scalar too: two compares per tile were
+// slower than the scalar stores in simd_bench.
+static const TilesKernels sse_kernels = { TilesKernels::SSE, "sse",
+		pack16_sse, unpack16_sse, manhattan16_sse, pack25_sse, unpack25_sse,
+		manhattan25_sse, inverse25_scalar, xor_hash25_scalar };
+
+// A 4x4 board fits in one 128-bit register, so its Manhattan kernel
+// is the SSE one.
+static const TilesKernels avx2_kernels = { TilesKernels::AVX2, "avx2",
+		pack16_avx2, unpack16_avx2, manhattan16_sse, pack25_avx2,
+		unpack25_avx2, manhattan25_avx2, inverse25_avx2, xor_hash25_avx2 };
+
+const TilesKernels *tiles_kernels(TilesKernels::Level level) {
+	__builtin_cpu_init();
+	switch (level) {
+	case TilesKernels::SCALAR:
+		return &scalar_kernels;
+	case TilesKernels::SSE:
+		if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1"))
+			return &sse_kernels;
+		break;
+	case TilesKernels::AVX2:
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+			return &avx2_kernels;
+		break;
+	}
+	return 0;
+}
+
+static const TilesKernels *select_kernels() {
+	const char *env = getenv("TILES_KERNELS");
+	if (env && strcmp(env, "scalar") == 0)
+		return &scalar_kernels;
+	const TilesKernels *k = tiles_kernels(TilesKernels::AVX2);
+	if (!k)
+		k = tiles_kernels(TilesKernels::SSE);
+	if (!k)
+		k = &scalar_kernels;
+	return k;
+}
+
+const TilesKernels &tiles_kernels() {
+	static const TilesKernels *best = select_kernels();
+	return *best;
+}
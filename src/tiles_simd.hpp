@@ -0,0 +1,53 @@
+/*
+ * tiles_simd.hpp
+ *
+ * Whole-board kernels for the sliding-tile domains (Tiles, Tiles24).
+ * Each kernel has a scalar version and SSE (SSSE3) and AVX2 (+BMI2)
+ * versions. The best level the CPU supports is picked at run time,
+ * so the binaries do not need to be built with -march.
+ *
+ * Boards are char arrays with tiles[i] the tile at position i and 0
+ * for the blank, as in Tiles::State and Tiles24::State.
+ */
+
+#ifndef TILES_SIMD_HPP_
+#define TILES_SIMD_HPP_
+
+#include <stdint.h>
+
+typedef unsigned int uint128_t __attribute__((mode(TI)));
+
+struct TilesKernels {
+	enum Level {
+		SCALAR = 0, SSE = 1, AVX2 = 2,
+	};
+
+	Level level;
+	const char *name;
+
+	// 4x4: 4 bits per tile, tile 0 in the most significant nibble.
+	uint64_t (*pack16)(const char tiles[16]);
+	// unpack16 returns the position of the blank.
+	int (*unpack16)(uint64_t word, char tiles[16]);
+	// Manhattan distance to the goal (tile t at position t), blank excluded.
+	unsigned int (*manhattan16)(const char tiles[16]);
+
+	// 5x5: 5 bits per tile, tile 0 in the most significant bits.
+	uint128_t (*pack25)(const char tiles[25]);
+	int (*unpack25)(uint128_t word, char tiles[25]);
+	unsigned int (*manhattan25)(const char tiles[25]);
+	// inverse25 sets inv[t] to the position of tile t.
+	void (*inverse25)(const char tiles[25], char inv[25]);
+	// XOR of tbl[i * 32 + tiles[i]] over all positions.
+	// tbl has 32 * 32 entries and is zero outside the 25 x 25 block.
+	uint64_t (*xor_hash25)(const char tiles[25], const unsigned int *tbl);
+};
+
+// tiles_kernels returns the kernels for the best level the CPU supports.
+const TilesKernels &tiles_kernels();
+
+// tiles_kernels returns the kernels for the given level, or 0 if the
+// CPU does not support it.
+const TilesKernels *tiles_kernels(TilesKernels::Level level);
+
+#endif /* TILES_SIMD_HPP_ */
@@ -15,6 +15,7 @@
 #include <random>
 
 #include "dist_hash.hpp"
+#include "fatal.hpp"
 
 template<typename D, int size>
 class Zobrist: public DistributionHash<D> {
@@ -67,6 +68,11 @@ public:
 		return 0;
 	}
 
+	unsigned int inc_hash(const unsigned int previous, const int number,
+			const int from, const int to) const {
+		return (previous ^ inc_zbr[number][from][to]);
+	}
+
 //#define RANDOM_ZOBRIST_INITIALIZATION
 private:
 	void initZobrist(ABST abst, unsigned int rand_seed = 0) {
@@ -81,6 +87,9 @@ private:
 		for (int j = 0; j < size; ++j) {
 			zbr[0][j] = 0;
 		}
+		if (layout(abst) != 0 && layout(abst) != size)
+			throw Fatal("Zobrist: abstraction %d is for %d cells, not %d",
+					(int) abst, layout(abst), size);
 
 		// TODO: Here, we can implement some kind of tricks for load balancing.
 		// 1. Abstraction
@@ -144,8 +153,7 @@ private:
 			sparsest_cut2();
 			break;
 		default:
-			printf("ERRRRRRRORRRRR\n");
-			break;
+			throw Fatal("Zobrist: unknown abstraction %d", (int) abst);
 		}
 
 		for (int i = 1; i < size; ++i) { // num
@@ -159,6 +167,26 @@ private:
 //		dump_table();
 	}
 
+	// layout returns the number of cells the places of an abstraction are
+	// hard-coded for, or 0 if they follow from size.
+	static int layout(ABST abst) {
+		switch (abst) {
+		case BLOCK:
+		case SZ4_ABST12345_15:
+		case SPARSEST_CUT:
+		case SPARSEST_CUT2:
+			return 16;
+		case FOURBLOCK_24:
+		case LINE_24:
+		case BLOCK_24:
+		case ODD_24:
+		case SZ5_ABST123456_24:
+			return 25;
+		default:
+			return 0;
+		}
+	}
+
 	void single() {
 		for (int i = 1; i < size; ++i) {
 			for (int j = 0; j < size; ++j) {
@@ -172,13 +200,17 @@ private:
 			for (int j = 0; j < size; j += 2) {
 				int r = random();
 				zbr[i][j] = r;
-				zbr[i][j + 1] = r;
+				if (j + 1 < size) // odd size: the last place is alone
+					zbr[i][j + 1] = r;
 			}
 		}
 	}
 
 	void line() {
 		const int width = sqrt(size);
+		if (width * width != size)
+			throw Fatal("Zobrist: line needs a square board, not %d cells",
+					size);
 		for (int i = 1; i < size; ++i) {
 			for (int j = 0; j < size; j += width) {
 				int r = random();
@@ -316,7 +348,7 @@ private:
 	}
 
 	void two(int abst = size) {
-		for (int i = 1; i < abst; ++i) {
+		for (int i = 1; i < abst && i < size; ++i) {
 			for (int two = 0; two < 1; ++two) {
 				int r = random();
 				for (int j = 0; j < size / 2; ++j) {
@@ -457,8 +489,8 @@ private:
 
 // The method to return zobrist value for the very first node.
 	unsigned int hash(const char* const board) const {
-		unsigned char h = '\0';
-		for (int i = 0; i < 16; ++i) {
+		unsigned int h = 0;
+		for (int i = 0; i < size; ++i) {
 			h = (h ^ zbr[board[i]][i]);
 		}
 		return h;